@@ -0,0 +1,211 @@
+/**
+ * Copyright 2011 Roy van Dam <roy@8bit.cx>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bench.h"
+
+#ifdef WITH_BENCHMARK
+
+// Frame sizes to be measured
+static const uint16_t bench_sizes[] = {64, 128, 256, 512};
+
+// Status register of the caller, restored by bench_stop
+static uint8_t bench_sreg;
+
+// Timer1 count at bench_start
+static uint16_t bench_begin;
+
+/**
+ * @function:   bench_start
+ * @brief:      Starts Timer1 as free running cycle counter.
+ *              Interrupts are disabled for the duration of
+ *              the measurement. The counter is not cleared,
+ *              it may be shared with the SPI statistics.
+ */
+static inline void
+bench_start(void)
+{
+    bench_sreg = SREG;
+
+    cli();
+
+    TCCR1A = 0;
+    TCCR1B = (1 << CS10);
+
+    bench_begin = TCNT1;
+}
+
+/**
+ * @function:   bench_stop
+ * @return:     Amount of CPU cycles since bench_start.
+ * @brief:      Stops the cycle counter and restores the
+ *              interrupt state saved by bench_start.
+ */
+static inline uint16_t
+bench_stop(void)
+{
+    uint16_t cycles = TCNT1 - bench_begin;
+
+#ifndef WITH_SPI_STATS
+    // Only needed by the benchmark
+    TCCR1B = 0;
+#endif
+
+    SREG = bench_sreg;
+
+    return cycles;
+}
+
+/**
+ * @function:   bench_rate
+ * @param:      Amount of bytes transferred.
+ * @param:      Amount of CPU cycles spend.
+ * @return:     Transfer rate in bytes/second.
+ */
+static uint32_t
+bench_rate(uint16_t length, uint16_t cycles)
+{
+    return ((uint32_t) length * (F_CPU / 1000UL) / cycles) * 1000UL;
+}
+
+/**
+ * @function:   bench_seek
+ * @param:      Controller memory address.
+ * @brief:      Points both buffer memory pointers to the
+ *              given address.
+ */
+static void
+bench_seek(uint16_t address)
+{
+    eth_write_byte(EWRPTL, address & 0xFF);
+    eth_write_byte(EWRPTH, address >> 8);
+    eth_write_byte(ERDPTL, address & 0xFF);
+    eth_write_byte(ERDPTH, address >> 8);
+}
+
+/**
+ * @function:   bench_spi
+ * @brief:      Measures the cycle count of ethernet controller
+ *              buffer memory transfers for a range of frame sizes,
+ *              comparing the plain byte-per-call loop against the
+ *              burst block transfer.
+ */
+void
+bench_spi(void)
+{
+    uint16_t cycles[4];
+    uint16_t length;
+    uint16_t i;
+    uint8_t  n;
+    bool     valid;
+
+    uint8_t* data = (uint8_t*) malloc(bench_sizes[sizeof(bench_sizes) / sizeof(bench_sizes[0]) - 1] + 1);
+
+    if(data == NULL) {
+        printf_P(PSTR("SPI bench: out of memory\n"));
+        return;
+    }
+
+    printf_P(PSTR("SPI bench over " SPI_TRANSPORT_NAME " (cycles, bytes/s)\n"));
+    printf_P(PSTR(" size       write loop     write burst       read loop      read burst\n"));
+
+    for(n = 0; n < sizeof(bench_sizes) / sizeof(bench_sizes[0]); n++) {
+        length = bench_sizes[n];
+
+        for(i = 0; i < length; i++) {
+            data[i] = (uint8_t) i;
+        }
+
+        // Byte-per-call write loop
+        bench_seek(ETH_REG_TX_START);
+        eth_select();
+        spi_write_byte(ENC28J60_WRITE_BUF_MEM);
+
+        bench_start();
+
+        for(i = 0; i < length; i++) {
+            spi_write_byte(data[i]);
+        }
+
+        cycles[0] = bench_stop();
+        eth_deselect();
+
+        // Burst write
+        bench_seek(ETH_REG_TX_START);
+        eth_select();
+        spi_write_byte(ENC28J60_WRITE_BUF_MEM);
+
+        bench_start();
+        spi_write_block(length, data);
+        cycles[1] = bench_stop();
+
+        eth_deselect();
+
+        // Byte-per-call read loop
+        bench_seek(ETH_REG_TX_START);
+        eth_select();
+        spi_write_byte(ENC28J60_READ_BUF_MEM);
+
+        bench_start();
+
+        for(i = 0; i < length; i++) {
+            data[i] = spi_read_byte();
+        }
+
+        cycles[2] = bench_stop();
+        eth_deselect();
+
+        // Burst read
+        bench_seek(ETH_REG_TX_START);
+        eth_select();
+        spi_write_byte(ENC28J60_READ_BUF_MEM);
+
+        bench_start();
+        spi_read_block(length, data);
+        cycles[3] = bench_stop();
+
+        eth_deselect();
+
+        // Verify the data survived the round trip
+        for(i = 0; (i < length) && (data[i] == (uint8_t) i); i++) {
+            continue;
+        }
+
+        valid = (i == length);
+
+        printf_P(PSTR(" %4u"), length);
+
+        for(i = 0; i < 4; i++) {
+            printf_P(PSTR("  %5u %7lu"), cycles[i], bench_rate(length, cycles[i]));
+        }
+
+        printf_P(valid ? PSTR("\n") : PSTR("  MISMATCH\n"));
+    }
+
+    printf_P(PSTR("\n"));
+
+    free(data);
+}
+
+#endif
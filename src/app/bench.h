@@ -0,0 +1,60 @@
+/**
+ * Copyright 2011 Roy van Dam <roy@8bit.cx>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "dev/eth.h"
+#include "dev/spi.h"
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+/**
+ * @function:   bench_spi
+ * @brief:      Measures the cycle count of ethernet controller
+ *              buffer memory transfers for a range of frame sizes,
+ *              comparing the plain byte-per-call loop against the
+ *              burst block transfer. The transport in use is named,
+ *              build with TARGET_SPI_TRANSPORT set to SPI and USART
+ *              to compare both. Results are printed in cycles
+ *              and bytes/second over stdout. Uses Timer1 as cycle
+ *              counter and overwrites the transmit buffer, so run
+ *              it right after eth_init and before any traffic.
+ *
+ *              Enabled by building with -DWITH_BENCHMARK.
+ */
+#ifdef WITH_BENCHMARK
+extern void bench_spi(void);
+#endif
+
+/* !_BENCH_H_ */
+#endif
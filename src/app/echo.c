@@ -40,6 +40,16 @@ echo_udp(struct udp_header_t* udp_header, uint8_t* data)
     memcpy(udp_header->ip.dest_addr, udp_header->ip.src_addr, 4);
     memcpy(udp_header->ip.src_addr, ip_get_host_addr(), 4);
 
+    // Echo the data held by the ethernet controller
+    net_set_reply_header(sizeof(struct udp_header_t));
+
+    // Checksum the echoed datagram in the ethernet controller
+    udp_header->checksum = 0;
+
+    net_set_reply_checksum(MAC_DEFAULT_HEADER_LENGTH + IP_DEFAULT_HEADER_LENGTH,
+                           offsetof(struct udp_header_t, checksum),
+                           ip_pseudo_sum(IP_PROTOCOL_UDP, htons(udp_header->length), &udp_header->ip));
+
     // Return packet
     return sizeof(struct udp_header_t) + (htons(udp_header->length) - UDP_DEFAULT_HEADER_LENGTH);
 }
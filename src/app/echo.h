@@ -30,6 +30,7 @@
 #include "net/util.h"
 #include "net/ip.h"
 #include "net/udp.h"
+#include "net/net.h"
 
 #ifndef _ECHO_H_
 #define _ECHO_H_
@@ -216,6 +216,11 @@
 #define MACON2_MATXRST    0x02
 #define MACON2_TFUNRST    0x01
 
+// ENC28J60 EFLOCON Register Bit Definitions
+#define EFLOCON_FULDPXS   0x04
+#define EFLOCON_FCEN1     0x02
+#define EFLOCON_FCEN0     0x01
+
 // ENC28J60 MACON3 Register Bit Definitions
 #define MACON3_PADCFG2    0x80
 #define MACON3_PADCFG1    0x40
@@ -247,6 +252,22 @@
 #define PHSTAT1_LLSTAT    0x0004
 #define PHSTAT1_JBSTAT    0x0002
 
+// ENC28J60 PHY PHSTAT2 Register Bit Definitions
+#define PHSTAT2_TXSTAT    0x2000
+#define PHSTAT2_RXSTAT    0x1000
+#define PHSTAT2_COLSTAT   0x0800
+#define PHSTAT2_LSTAT     0x0400
+#define PHSTAT2_DPXSTAT   0x0200
+#define PHSTAT2_PLRITY    0x0020
+
+// ENC28J60 PHY PHIE Register Bit Definitions
+#define PHIE_PLNKIE       0x0010
+#define PHIE_PGEIE        0x0002
+
+// ENC28J60 PHY PHIR Register Bit Definitions
+#define PHIR_PLNKIF       0x0010
+#define PHIR_PGIF         0x0004
+
 // ENC28J60 PHY PHCON2 Register Bit Definitions
 #define PHCON2_FRCLINK    0x4000
 #define PHCON2_TXDIS      0x2000
@@ -259,6 +280,16 @@
 #define PKTCTRL_PCRCEN    0x02
 #define PKTCTRL_POVERRIDE 0x01
 
+// ENC28J60 Transmit Status Vector Bit Definitions(per byte)
+#define TSV_LENGTH        7
+#define TSV2_DONE         0x80
+#define TSV2_COLCNT       0x0F
+#define TSV3_UNDERRUN     0x80
+#define TSV3_LATECOL      0x20
+#define TSV3_EXCOL        0x10
+#define TSV3_EXDEFER      0x08
+#define TSV3_DEFER        0x04
+
 // SPI operation codes
 #define ENC28J60_READ_CTRL_REG       0x00
 #define ENC28J60_READ_BUF_MEM        0x3A
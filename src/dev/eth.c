@@ -27,9 +27,167 @@
 #include "eth.h"
 #include "spi.h"
 
+// External interrupt settings for the controller INT line
+#if defined(__AVR_ATmega16__) || defined(__AVR_ATmega32__)
+    #define ETH_INT_vect     INT0_vect
+    #define ETH_INT_MASK     GICR
+    #define ETH_INT_ENABLE   INT0
+    #define ETH_INT_SENSE    MCUCR
+    #define ETH_INT_FALLING  ((1 << ISC01) | (0 << ISC00))
+#elif defined(__AVR_ATmega644P__) || defined(__AVR_ATmega644PA__) || \
+      defined(__AVR_ATmega1284__) || defined(__AVR_ATmega1284P__)
+    #if defined(SPI_TRANSPORT_USART)
+        #define ETH_INT_vect     INT2_vect
+        #define ETH_INT_MASK     EIMSK
+        #define ETH_INT_ENABLE   INT2
+        #define ETH_INT_SENSE    EICRA
+        #define ETH_INT_FALLING  ((1 << ISC21) | (0 << ISC20))
+    #else
+        #define ETH_INT_vect     INT0_vect
+        #define ETH_INT_MASK     EIMSK
+        #define ETH_INT_ENABLE   INT0
+        #define ETH_INT_SENSE    EICRA
+        #define ETH_INT_FALLING  ((1 << ISC01) | (0 << ISC00))
+    #endif
+#else
+    #error *** Check interrupt settings in eth.c ***
+#endif
+
 // Global status variables
 static uint8_t  eth_bank_pointer;
 static uint16_t eth_packet_pointer;
+static uint16_t eth_frame_pointer;
+
+// Length of the packet returned by the last eth_peek_packet call
+static uint16_t eth_frame_length;
+
+// Received packets counted in the controller and not yet released
+static uint8_t  eth_rx_count;
+
+// Shadow copies of the pointer registers written per frame, the
+// bank select bits of ECON1 are shadowed by eth_bank_pointer. The
+// other ECON1 bits are changed by the controller itself.
+static uint16_t eth_shadow_erxrdpt;
+static uint16_t eth_shadow_etxst;
+static uint16_t eth_shadow_etxnd;
+
+// Events gathered by the interrupt routine
+static volatile uint8_t eth_events;
+
+// Time EPKTCNT was last checked by eth_rx_poll
+static struct clock_time_t eth_rx_poll_stamp;
+
+// Nesting depth of eth_lock
+static uint8_t  eth_lock_depth;
+
+// Time the interrupt routine last saw a received packet, and
+// the arrival time of the packet being handled
+static struct clock_time_t eth_rx_stamp;
+static struct clock_time_t eth_frame_stamp;
+
+// Set while eth_rx_stamp has not been handed to a packet
+static volatile bool eth_rx_stamp_fresh;
+
+#ifdef WITH_ETH_RX_ISR
+// Frame ring, filled at the head by the interrupt routine and
+// consumed from the tail by the main loop. Each index is only
+// written by one side so no further locking is needed.
+static volatile uint8_t  eth_rx_ring_head;
+static volatile uint8_t  eth_rx_ring_tail;
+static volatile uint16_t eth_rx_ring_length[ETH_RX_RING_SLOTS];
+static struct clock_time_t eth_rx_ring_stamp[ETH_RX_RING_SLOTS];
+static uint8_t  eth_rx_ring[ETH_RX_RING_SLOTS][ETH_RX_RING_FRAME_SIZE];
+#endif
+
+// Transmit slot ring, frames are sent from tail to head
+static uint8_t  eth_tx_head;
+static uint8_t  eth_tx_tail;
+static uint8_t  eth_tx_count;
+static uint16_t eth_tx_length[ETH_TX_SLOTS];
+
+#ifdef WITH_ETH_TX_STATUS
+// Retransmissions of the frame at the tail
+static uint8_t  eth_tx_retries;
+#endif
+
+// Receive error statistics
+static struct eth_stats_t eth_stats;
+
+// Flow control state
+static bool eth_flow_enabled;
+static bool eth_flow_paused;
+static bool eth_flow_full_duplex;
+
+// Receive filter settings(ERXFCON)
+static uint8_t  eth_rx_filter;
+
+// Joined multicast groups
+static uint8_t  eth_multicast_count;
+static uint8_t  eth_multicast_groups[ETH_MULTICAST_GROUPS][6];
+
+// Default pattern, broadcast ARP packets
+static const uint8_t eth_broadcast_addr[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const uint8_t eth_type_arp[2] = {0x08, 0x06};
+
+static const struct eth_filter_field_t eth_default_filter[] = {
+    {0, 6, eth_broadcast_addr},
+    {12, 2, eth_type_arp}
+};
+
+// Register settings applied after a reset, sorted by bank so
+// every bank is selected only once.
+static const uint8_t eth_init_table[][2] PROGMEM = {
+    // Bank 0: receive and transmit buffer boundaries
+    {ERXSTL,   ETH_REG_RX_START & 0xFF},
+    {ERXSTH,   ETH_REG_RX_START >> 8},
+    {ERXRDPTL, ETH_REG_RX_START & 0xFF},
+    {ERXRDPTH, ETH_REG_RX_START >> 8},
+    {ERXNDL,   ETH_REG_RX_STOP & 0xFF},
+    {ERXNDH,   ETH_REG_RX_STOP >> 8},
+    {ETXSTL,   ETH_REG_TX_START & 0xFF},
+    {ETXSTH,   ETH_REG_TX_START >> 8},
+    {ETXNDL,   ETH_REG_TX_STOP & 0xFF},
+    {ETXNDH,   ETH_REG_TX_STOP >> 8},
+
+    // Bank 1: unicast packets for our mac(MAADR) with a valid CRC
+    {ERXFCON,  ERXFCON_UCEN | ERXFCON_CRCEN},
+
+    // Bank 2: enable the MAC receiver and pause frame handling
+    {MACON1,   MACON1_MARXEN | MACON1_TXPAUS | MACON1_RXPAUS},
+    {MACON2,   0x00},
+
+#ifdef WITH_FULL_DUPLEX
+    // Automatic padding to 60 bytes, CRC operations and full duplex
+    {MACON3,   MACON3_PADCFG0 | MACON3_TXCRCEN | MACON3_FRMLNEN | MACON3_FULDPX},
+
+    // Inter-frame gaps(non-back-to-back and back-to-back)
+    {MAIPGL,   0x12},
+    {MABBIPG,  0x15},
+#else
+    // Automatic padding to 60 bytes and CRC operations
+    {MACON3,   MACON3_PADCFG0 | MACON3_TXCRCEN | MACON3_FRMLNEN},
+
+    // Inter-frame gaps(non-back-to-back and back-to-back)
+    {MAIPGL,   0x12},
+    {MAIPGH,   0x0C},
+    {MABBIPG,  0x12},
+#endif
+
+    // Maximum packet size which the controller will accept
+    {MAMXFLL,  ETH_MAX_FRAME_LENGTH & 0xFF},
+    {MAMXFLH,  ETH_MAX_FRAME_LENGTH >> 8}
+};
+
+// Receive buffer pointers restored by eth_rx_reset
+static const struct eth_reg_write_t eth_rx_reset_table[] PROGMEM = {
+    {ERXSTL,   ETH_REG_RX_START & 0xFF},
+    {ERXSTH,   ETH_REG_RX_START >> 8},
+    {ERXRDPTL, ETH_REG_RX_START & 0xFF},
+    {ERXRDPTH, ETH_REG_RX_START >> 8}
+};
+
+// Start address of a transmit slot
+#define ETH_TX_SLOT(slot) (ETH_REG_TX_START + ((uint16_t)(slot) * ETH_TX_SLOT_SIZE))
 
 /**
  * @function:   eth_enable
@@ -51,6 +209,48 @@ eth_disable(void)
     ETH_RESET_PORT &= ~(1 << ETH_RESET_PIN);
 }
 
+/**
+ * @function:   eth_lock
+ * @brief:      Holds off the controller interrupt until the matching
+ *              eth_unlock call, so a sequence of transactions is not
+ *              interleaved with those of the interrupt routine.
+ *              Calls may be nested.
+ */
+inline void
+eth_lock(void)
+{
+    uint8_t sreg = SREG;
+
+    // The mask register is shared with the other external interrupts
+    cli();
+
+    // A pending edge is latched and serviced on unlock
+    ETH_INT_MASK &= ~(1 << ETH_INT_ENABLE);
+
+    eth_lock_depth++;
+
+    SREG = sreg;
+}
+
+/**
+ * @function:   eth_unlock
+ * @brief:      Releases the controller interrupt held off by the
+ *              matching eth_lock call.
+ */
+inline void
+eth_unlock(void)
+{
+    uint8_t sreg = SREG;
+
+    cli();
+
+    if(--eth_lock_depth == 0) {
+        ETH_INT_MASK |= (1 << ETH_INT_ENABLE);
+    }
+
+    SREG = sreg;
+}
+
 /**
  * @function:   eth_select
  * @brief:      Select the ethernet controller
@@ -59,6 +259,10 @@ eth_disable(void)
 inline void
 eth_select(void)
 {
+    // Hold off the controller interrupt, it talks to the
+    // controller itself.
+    eth_lock();
+
     ETH_SELECT_PORT &= ~(1 << ETH_SELECT_PIN);
 }
 
@@ -71,6 +275,8 @@ inline void
 eth_deselect(void)
 {
     ETH_SELECT_PORT |= (1 << ETH_SELECT_PIN);
+
+    eth_unlock();
 }
 
 /**
@@ -81,6 +287,8 @@ eth_deselect(void)
 void
 eth_init(uint8_t* mac_address)
 {
+    uint16_t i;
+
     // Initialise SPI driver
     spi_init();
 
@@ -88,106 +296,81 @@ eth_init(uint8_t* mac_address)
     ETH_SELECT_DDR |= (1 << ETH_SELECT_PIN);
     ETH_RESET_DDR |= (1 << ETH_RESET_PIN);
 
+    // Init interrupt line(input with pull-up, falling edge)
+    ETH_INT_DDR  &= ~(1 << ETH_INT_PIN);
+    ETH_INT_PORT |= (1 << ETH_INT_PIN);
+    ETH_INT_SENSE |= ETH_INT_FALLING;
+
+    // Make sure the first poll looks for packets
+    eth_events = ETH_EVENT_RX;
+
     // Enable controller
     eth_enable();
 
     // Disconnect controller from SPI bus
-    eth_deselect();
+    ETH_SELECT_PORT |= (1 << ETH_SELECT_PIN);
 
     // Softreset the controller
     eth_write_opcode(ENC28J60_SOFT_RESET, 0, ENC28J60_SOFT_RESET);
 
-    // Check CLKRDY bit to see if reset is complete
-    // while (!(eth_read_byte(ESTAT) & ESTAT_CLKRDY));
-    // See Rev. B4 Silicon Errata point 2.
-    _delay_ms(100);
+    // CLKRDY is not cleared by a soft reset, wait for the clock to
+    // stop first(see Rev. B4 Silicon Errata point 2). Then wait for
+    // the oscillator, which takes longer after a power-up.
+    _delay_ms(1);
 
-    /**
-     * Initialise BANK 0
-     */
+    for(i = 0; (i < ETH_RESET_POLLS) && !(eth_read_opcode(ENC28J60_READ_CTRL_REG, ESTAT) & ESTAT_CLKRDY); i++) {
+        _delay_us(100);
+    }
+
+    // The reset selected bank 0
+    eth_bank_pointer = 0;
 
     // Initialize receive buffer
     eth_packet_pointer = ETH_REG_RX_START;
+    eth_frame_pointer = ETH_REG_RX_START;
 
-    // Controller RX buffer start address
-    eth_write_byte(ERXSTL,   ETH_REG_RX_START & 0xFF);
-    eth_write_byte(ERXSTH,   ETH_REG_RX_START >> 8);
-    eth_write_byte(ERXRDPTL, ETH_REG_RX_START & 0xFF);
-    eth_write_byte(ERXRDPTH, ETH_REG_RX_START >> 8);
+    // Apply the register settings
+    for(i = 0; i < sizeof(eth_init_table) / sizeof(eth_init_table[0]); i++) {
+        eth_write_byte(pgm_read_byte(&eth_init_table[i][0]), pgm_read_byte(&eth_init_table[i][1]));
+    }
 
-    // Controller RX buffer stop address
-    eth_write_byte(ERXNDL,   ETH_REG_RX_STOP & 0xFF);
-    eth_write_byte(ERXNDH,   ETH_REG_RX_STOP >> 8);
+    // The pointers now hold the values of the register settings
+    eth_shadow_erxrdpt = ETH_REG_RX_START;
+    eth_shadow_etxst = ETH_REG_TX_START;
+    eth_shadow_etxnd = ETH_REG_TX_STOP;
 
-    // Controller TX buffer start address
-    eth_write_byte(ETXSTL,   ETH_REG_TX_START & 0xFF);
-    eth_write_byte(ETXSTH,   ETH_REG_TX_START >> 8);
+    // Set the hardware mac address
+    eth_set_mac(mac_address);
 
-    // Controller TX buffer start address
-    eth_write_byte(ETXNDL,   ETH_REG_TX_STOP & 0xFF);
-    eth_write_byte(ETXNDH,   ETH_REG_TX_STOP >> 8);
+#ifdef WITH_FULL_DUPLEX
+    // Force the PHY into full duplex, the controller does not
+    // auto-negotiate so the link partner must be set to match.
+    eth_write_phy(PHCON1, PHCON1_PDPXMD);
+#endif
 
-    /**
-     * Initialise BANK 1
-     */
+    // No loopback of transmitted frames
+    eth_write_phy(PHCON2, PHCON2_HDLDIS);
+
+    // Report link changes
+    eth_write_phy(PHIE, PHIE_PGEIE | PHIE_PLNKIE);
 
     /**
      * Packet filter:
      *	For broadcast packets we allow only ARP packtets
      *	All other packets should be unicast only for our mac(MAADR)
-     *
-     *	The pattern to match on is therefore
-     *	Type     ETH.DST
-     *	ARP      BROADCAST
-     *	06 08 -- ff ff ff ff ff ff -> ip checksum for theses bytes=f7f9
-     *	in binary these poitions are:11 0000 0011 1111
-     *	This is hex 303F->EPMM0=0x3f,EPMM1=0x30
-     */
-    eth_write_byte(ERXFCON, ERXFCON_UCEN | ERXFCON_CRCEN | ERXFCON_PMEN);
-    eth_write_byte(EPMM0,   0x3F);
-    eth_write_byte(EPMM1,   0x30);
-    eth_write_byte(EPMCSL,  0xF9);
-    eth_write_byte(EPMCSH,  0xF7);
-
-    /**
-     * Initialise BANK 2
-     */
-
-    // Enable MAC receiver
-    eth_write_byte(MACON1, MACON1_MARXEN | MACON1_TXPAUS | MACON1_RXPAUS);
-
-    // Reset MAC receiver
-    eth_write_byte(MACON2, 0x00);
-
-    // Enable automatic padding to 60 bytes and CRC operations
-    eth_write_opcode(ENC28J60_BIT_FIELD_SET, MACON3, MACON3_PADCFG0 | MACON3_TXCRCEN | MACON3_FRMLNEN);
-
-    // Set inter-frame gap(non-back-to-back)
-    eth_write_byte(MAIPGL, 0x12);
-    eth_write_byte(MAIPGH, 0x0C);
-
-    // Set inter-frame gap(back-to-back)
-    eth_write_byte(MABBIPG, 0x12);
-
-    // Set the maximum packet size which the controller will accept
-    eth_write_byte(MAMXFLL, ETH_MAX_FRAME_LENGTH & 0xFF);
-    eth_write_byte(MAMXFLH, ETH_MAX_FRAME_LENGTH >> 8);
-
-    /**
-     * Initialise BANK 3
      */
-
-    // Set the hardware mac address
-    eth_set_mac(mac_address);
-
-    // No loopback of transmitted frames
-    eth_write_phy(PHCON2, PHCON2_HDLDIS);
+    eth_rx_filter = ERXFCON_UCEN | ERXFCON_CRCEN;
+    eth_set_pattern_filter(eth_default_filter, 2);
 
     // Switch to bank 0
     eth_set_bank(ECON1);
 
     // Enable interrutps
-    eth_write_opcode(ENC28J60_BIT_FIELD_SET, EIE, EIE_INTIE | EIE_PKTIE);
+    eth_write_opcode(ENC28J60_BIT_FIELD_SET, EIE, EIE_INTIE | EIE_PKTIE | EIE_TXIE | EIE_TXERIE | EIE_LINKIE | EIE_RXERIE);
+
+#ifdef WITH_FLOW_CONTROL
+    eth_set_flow_control(true);
+#endif
 
     // Enable packet reception
     eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_RXEN);
@@ -211,21 +394,39 @@ void eth_set_mac(uint8_t* mac_address)
 /**
  * @function:   eth_set_bank
  * @param:      address, bank address to be set
- * @brief:      Sets the bank pointer
+ * @brief:      Sets the bank pointer, only changing the bank
+ *              select bits that differ.
  */
 void
 eth_set_bank(uint8_t address)
 {
     uint8_t address_masked = address & BANK_MASK;
+    uint8_t clear, set;
 
     // Bank already active?
     if(address_masked != eth_bank_pointer) {
-        // Set the bank
-        eth_write_opcode(ENC28J60_BIT_FIELD_CLR, ECON1, (ECON1_BSEL1 | ECON1_BSEL0));
-        eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON1, (address_masked) >> 5);
+        // The interrupt routine must not see a half switched bank
+        eth_lock();
+        SPI_STATS_BEGIN(SPI_STATS_BANK);
+
+        // Set the bank, ECON1 is never written as a whole as the
+        // controller changes its other bits.
+        clear = (eth_bank_pointer & ~address_masked) >> 5;
+        set = (address_masked & ~eth_bank_pointer) >> 5;
+
+        if(clear) {
+            eth_write_opcode(ENC28J60_BIT_FIELD_CLR, ECON1, clear);
+        }
+
+        if(set) {
+            eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON1, set);
+        }
 
         // Update local bank pointer
         eth_bank_pointer = address_masked;
+
+        SPI_STATS_END();
+        eth_unlock();
     }
 }
 
@@ -252,12 +453,19 @@ eth_set_clock(uint8_t value)
  * @function:   eth_get_rx_packet_count
  * @return:     Amount of pending packets in the controller.
  * @brief:      Returns the amound of unprocessed packets stored
- *              in the ethernet controller.
+ *              in the ethernet controller. The counter is only read
+ *              again once the packets seen last time are released,
+ *              later arrivals show up from then on.
  */
 uint8_t
 eth_get_rx_packet_count(void)
 {
-    return eth_read_byte(EPKTCNT);
+    // Saves the switch to bank 1 for all but the first of a burst
+    if(eth_rx_count == 0) {
+        eth_rx_count = eth_read_byte(EPKTCNT);
+    }
+
+    return eth_rx_count;
 }
 
 /**
@@ -268,264 +476,1346 @@ eth_get_rx_packet_count(void)
 uint8_t
 eth_get_link_status(void)
 {
-    return (eth_read_phy_h(PHSTAT2) && 4);
-}
-
-/**
- * @function:   eth_get_link_status
- * @return:     Core revision number.
- * @brief:      Returns the core revision numer of the ethernet controller.
- */
-uint8_t
-eth_get_revision(void)
-{
-    return eth_read_byte(EREVID);
+    return (eth_read_phy_h(PHSTAT2) & PHSTAT2_LSTAT) ? 1 : 0;
 }
 
 /**
- * @function:   eth_read_byte
- * @param:      Register address to be read.
- * @return:     Byte of data read from the controller.
- * @brief:      Reads a byte of 8 bits from the ethernet controller.
+ * @function:   eth_ack_link_change
+ * @return:     The current status value of the ethernet link.
+ * @brief:      Acknowledges a link change(ETH_EVENT_LINK) and
+ *              returns the new status of the ethernet link.
  */
 uint8_t
-eth_read_byte(uint8_t address)
+eth_ack_link_change(void)
 {
-    // Set the bank
-    eth_set_bank(address);
+    // Reading PHIR clears the interrupt flags
+    eth_read_phy_h(PHIR);
 
-    // Read the data form controller
-    return eth_read_opcode(ENC28J60_READ_CTRL_REG, address);
+    return eth_get_link_status();
 }
 
 /**
- * @function:   eth_write_byte
- * @param:      Register address to be written.
- * @param:      Byte of data to be send to the controller.
- * @brief:      Writes a byte of 8 bits to the ethernet controller.
+ * @function:   eth_is_full_duplex
+ * @return:     True when operating in full duplex mode.
+ * @brief:      Returns the duplex mode the MAC is configured for.
  */
-void
-eth_write_byte(uint8_t address, uint8_t data)
+bool
+eth_is_full_duplex(void)
 {
-    // Set the bank
-    eth_set_bank(address);
-
-    // Write data to controller
-    eth_write_opcode(ENC28J60_WRITE_CTRL_REG, address, data);
+    return (eth_read_byte(MACON3) & MACON3_FULDPX) ? true : false;
 }
 
 /**
- * @function:   eth_read_phy_h
- * @param:      PHY register address to be read.
- * @param:      Word of data read from the PHY register.
- * @brief:      Reads the high byte of a 16 bit PHY register located
- *              at the ethernet controller.
+ * @function:   eth_get_rx_occupancy
+ * @return:     Number of bytes in use in the receive buffer.
+ * @brief:      Samples the receive buffer fill level, the distance
+ *              between the hardware write pointer(ERXWRPT) and the
+ *              oldest packet held(ERXRDPT). At most ETH_RX_BUFFER_SIZE.
  */
 uint16_t
-eth_read_phy_h(uint8_t address)
+eth_get_rx_occupancy(void)
 {
-    // Select register address
-    eth_write_byte(MIREGADR, address);
+    uint16_t write_pointer;
+    uint16_t occupancy;
 
-    // Start the register read operation
-    eth_write_byte(MICMD, MICMD_MIIRD);
+    // The frame pointer may be moved by the interrupt routine
+    eth_lock();
 
-    // Wait until the PHY read completes
-    _delay_us(15);
+    write_pointer  = eth_read_byte(ERXWRPTL);
+    write_pointer |= eth_read_byte(ERXWRPTH) << 8;
 
-    while(eth_read_byte(MISTAT) & MISTAT_BUSY);
+    // The read pointer trails the oldest packet held, which is
+    // tracked here to save reading ERXRDPT back.
+    if(write_pointer >= eth_frame_pointer) {
+        occupancy = write_pointer - eth_frame_pointer;
+    } else {
+        occupancy = ETH_RX_BUFFER_SIZE - (eth_frame_pointer - write_pointer);
+    }
 
-    // Reset reading bit
-    eth_write_byte(MICMD, 0x00);
+    eth_unlock();
 
-    // Read the actual byte and return
-    return(uint16_t)(eth_read_byte(MIRDH) << 8);
+    return occupancy;
 }
 
 /**
- * @function:   eth_write_phy
- * @param:      PHY register address to be written.
- * @param:      Word of data to be send to the PHY register.
- * @brief:      Writes a word of 16 bits to the PHY register located
- *              at the ethernet controller.
+ * @function:   eth_get_link_status
+ * @return:     Core revision number.
+ * @brief:      Returns the core revision numer of the ethernet controller.
  */
-void
-eth_write_phy(uint8_t address, uint16_t data)
+uint8_t
+eth_get_revision(void)
 {
-    // Set the PHY register address
-    eth_write_byte(MIREGADR, address);
-
-    // Write the PHY data
-    eth_write_byte(MIWRL, data);
-    eth_write_byte(MIWRH, data >> 8);
-
-    // Wait until the PHY write completes
-    while(eth_read_byte(MISTAT) & MISTAT_BUSY) {
-        _delay_us(15);
-    }
+    return eth_read_byte(EREVID);
 }
 
 /**
- * @function:   eth_read_opcode
- * @param:      Operation instruction code.
- * @param:      Involving register address.
- * @return:     Byte of data read from the controller.
- * @brief:      Write an operation to the controller following an
- *              8 bit read containing the result of the operation.
+ * @function:   eth_set_pattern_filter
+ * @param:      Fields the packets have to match.
+ * @param:      Number of fields, zero disables the filter.
+ * @return:     True when the filter has been set, false when the
+ *              fields do not fit the 64 byte match window.
+ * @brief:      Programs the pattern match filter, passing packets
+ *              that match all given fields. This replaces the
+ *              current pattern, only one can be active.
  */
-uint8_t
-eth_read_opcode(uint8_t opcode, uint8_t address)
+bool
+eth_set_pattern_filter(const struct eth_filter_field_t* fields, uint8_t count)
 {
-    uint8_t result = 0;
+    uint8_t window[64];
+    uint8_t mask[8] = {0};
+    uint8_t start = 0xFF;
+    uint16_t position;
+    uint32_t sum = 0;
+    bool high = true;
+    uint8_t i, j;
+
+    // Disable the filter when there is nothing to match
+    if(count == 0) {
+        eth_rx_filter &= ~ERXFCON_PMEN;
+        eth_write_byte(ERXFCON, eth_rx_filter);
+
+        return true;
+    }
 
-    // Check if the SPI interface is avaiable
-    spi_wait();
+    // The match window starts at the first field
+    for(i = 0; i < count; i++) {
+        if(fields[i].offset < start) {
+            start = fields[i].offset;
+        }
+    }
 
-    // Select controller
-    eth_select();
+    // Place the fields in the window and select their bytes
+    for(i = 0; i < count; i++) {
+        for(j = 0; j < fields[i].length; j++) {
+            position = fields[i].offset + j - start;
 
-    // Issue read command
-    spi_write_byte(opcode | (address & ADDR_MASK));
+            if(position >= 64) {
+                return false;
+            }
 
-    // Read data
-    result = spi_read_byte();
+            window[position] = fields[i].data[j];
+            mask[position >> 3] |= 1 << (position & 0x07);
+        }
+    }
 
-    // Do dummy read if needed(for mac and mii, see datasheet page 29)
-    if(address & 0x80) {
-        result = spi_read_byte();
+    // The checksum is calculated over the selected bytes as if
+    // they were one stream of data(see datasheet page 48)
+    for(position = 0; position < 64; position++) {
+        if(!(mask[position >> 3] & (1 << (position & 0x07)))) {
+            continue;
+        }
+
+        sum += (high) ? (uint16_t)(window[position] << 8) : window[position];
+        high = !high;
     }
 
-    // Deselect controller
-    eth_deselect();
+    // Take only 16 bits out of the 32 bit sum and add up the carries
+    while(sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
 
-    return (result);
+    // One's complement the result
+    sum = ~sum;
+
+    // Program the filter
+    for(i = 0; i < 8; i++) {
+        eth_write_byte(EPMM0 + i, mask[i]);
+    }
+
+    eth_write_byte(EPMOL,  start);
+    eth_write_byte(EPMOH,  0x00);
+    eth_write_byte(EPMCSL, sum & 0xFF);
+    eth_write_byte(EPMCSH, (sum >> 8) & 0xFF);
+
+    // Enable the pattern match filter
+    if(!(eth_rx_filter & ERXFCON_PMEN)) {
+        eth_rx_filter |= ERXFCON_PMEN;
+        eth_write_byte(ERXFCON, eth_rx_filter);
+    }
+
+    return true;
 }
 
 /**
- * @function:   eth_write_opcode
- * @param:      Operation instruction code.
- * @param:      Involving register address.
- * @param:      Byte of data to be send to the controller.
- * @brief:      Write an opcode to the controller.
+ * @function:   eth_hash
+ * @param:      Mac address to be hashed.
+ * @return:     Hash table bit(0 to 63) of the address.
+ * @brief:      Calculates the CRC-32 of the address the same way
+ *              the controller does, bits 28:23 select the hash
+ *              table bit(see datasheet page 50).
  */
-void
-eth_write_opcode(uint8_t opcode, uint8_t address, uint8_t data)
+static uint8_t
+eth_hash(const uint8_t* mac_address)
 {
-    // Check if the SPI interface is avaiable
-    spi_wait();
-
-    // Select controller
-    eth_select();
-
-    // Issue write command
-    spi_write_byte(opcode | (address & ADDR_MASK));
-
-    // Write data
-    spi_write_byte(data);
+    uint32_t crc = 0xFFFFFFFF;
+    uint8_t data;
+    uint8_t i, j;
+
+    // Shift in the address, least significant bit first
+    for(i = 0; i < 6; i++) {
+        data = mac_address[i];
+
+        for(j = 0; j < 8; j++) {
+            if(((uint8_t)(crc >> 31) ^ data) & 0x01) {
+                crc = (crc << 1) ^ 0x04C11DB7;
+            } else {
+                crc = (crc << 1);
+            }
+
+            data >>= 1;
+        }
+    }
 
-    // Deselect controller
-    eth_deselect();
+    return (crc >> 23) & 0x3F;
 }
 
 /**
- * @function:   eth_read_buffer
- * @param:      Lenght of data to be read from the memory.
- * @param:      Local data buffer to be written to.
- * @brief:      Reads a chunk of data from the memory located
- *              in the ethernet controller.
+ * @function:   eth_join_multicast
+ * @param:      Multicast mac address to be received.
+ * @return:     True when the group has been joined.
+ * @brief:      Adds a multicast address to the hash table filter
+ *              so packets sent to the group reach the host.
  */
-void
-eth_read_buffer(uint16_t length, uint8_t* data)
+bool
+eth_join_multicast(const uint8_t* mac_address)
 {
-    // Check if the SPI interface is avaiable
-    spi_wait();
-
-    // Select controller
-    eth_select();
+    uint8_t hash;
 
-    // Issue read command
-    spi_write_byte(ENC28J60_READ_BUF_MEM);
+    // Only group addresses can be joined
+    if(!(mac_address[0] & 0x01)) {
+        return false;
+    }
 
-    while(length--) {
-        // Read data
-        *data = spi_read_byte();
+    // Already a member?
+    if(eth_is_multicast_member(mac_address)) {
+        return true;
+    }
 
-        // Increment data pointer
-        data++;
+    // Group table full?
+    if(eth_multicast_count == ETH_MULTICAST_GROUPS) {
+        return false;
     }
 
-    // Add string delimiter
-    *data = '\0';
+    memcpy(eth_multicast_groups[eth_multicast_count++], mac_address, 6);
 
-    // Deselect controller
-    eth_deselect();
+    // Set the hash table bit of the group
+    hash = eth_hash(mac_address);
+
+    eth_set_bank(EHT0);
+    eth_write_opcode(ENC28J60_BIT_FIELD_SET, EHT0 + (hash >> 3), 1 << (hash & 0x07));
+
+    // Enable the hash table filter
+    if(!(eth_rx_filter & ERXFCON_HTEN)) {
+        eth_rx_filter |= ERXFCON_HTEN;
+        eth_write_byte(ERXFCON, eth_rx_filter);
+    }
+
+    return true;
 }
 
 /**
- * @function:   eth_write_buffer
- * @param:      Lenght of data to be written to the memory.
- * @param:      Local data buffer to be read from.
- * @brief:      Write a chunk of data to the memory located
- *              in the ethernet controller.
+ * @function:   eth_leave_multicast
+ * @param:      Multicast mac address no longer to be received.
+ * @return:     True when the group has been left.
+ * @brief:      Removes a multicast address from the hash table filter.
  */
-void
-eth_write_buffer(uint16_t length, uint8_t* data)
+bool
+eth_leave_multicast(const uint8_t* mac_address)
 {
-    // Check if the SPI interface is avaiable
-    spi_wait();
+    uint8_t table[8] = {0};
+    uint8_t hash;
+    uint8_t i;
 
-    // Select controller
-    eth_select();
+    // Find the group
+    for(i = 0; (i < eth_multicast_count) && memcmp(eth_multicast_groups[i], mac_address, 6); i++) {
+        continue;
+    }
 
-    // Issue read command
-    spi_write_byte(ENC28J60_WRITE_BUF_MEM);
+    if(i == eth_multicast_count) {
+        return false;
+    }
 
-    while(length--) {
-        // Write data
-        spi_write_byte(*data);
+    // Replace it by the last group
+    memcpy(eth_multicast_groups[i], eth_multicast_groups[--eth_multicast_count], 6);
 
-        // Increment data pointer
-        data++;
+    // Rebuild the hash table, the bit may be shared with other groups
+    for(i = 0; i < eth_multicast_count; i++) {
+        hash = eth_hash(eth_multicast_groups[i]);
+        table[hash >> 3] |= 1 << (hash & 0x07);
     }
 
-    // Deselect controller
-    eth_deselect();
+    for(i = 0; i < 8; i++) {
+        eth_write_byte(EHT0 + i, table[i]);
+    }
+
+    // Disable the hash table filter when no groups are left
+    if(eth_multicast_count == 0) {
+        eth_rx_filter &= ~ERXFCON_HTEN;
+        eth_write_byte(ERXFCON, eth_rx_filter);
+    }
+
+    return true;
 }
 
 /**
- * @function:   eth_send_packet
- * @param:      Lenght of the packet to be send.
- * @param:      Local packet buffer to be read from.
- * @brief:      Sends an ethernet packet to the ethernet controller.
+ * @function:   eth_is_multicast_member
+ * @param:      Multicast mac address.
+ * @return:     True when the group has been joined.
+ * @brief:      The hash table filter also passes groups sharing a
+ *              hash bit with a joined group, use this to drop them.
  */
-void
-eth_send_packet(uint16_t length, uint8_t* packet)
+bool
+eth_is_multicast_member(const uint8_t* mac_address)
 {
-    // Check if transmit is in progress
-    while(eth_read_opcode(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_TXRTS) {
-        // Reset the transmit logic problem. See Rev. B4 Silicon Errata point 12.
-        if((eth_read_byte(EIR) & EIR_TXERIF)) {
-            eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRST);
-            eth_write_opcode(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRST);
+    uint8_t i;
+
+    for(i = 0; i < eth_multicast_count; i++) {
+        if(memcmp(eth_multicast_groups[i], mac_address, 6) == 0) {
+            return true;
         }
     }
 
-    // Set the write pointer to start of transmit buffer area
-    eth_write_byte(EWRPTL, ETH_REG_TX_START & 0xFF);
-    eth_write_byte(EWRPTH, ETH_REG_TX_START >> 8);
-
-    // Set the TXND pointer to correspond to the packet size given
-    eth_write_byte(ETXNDL, (ETH_REG_TX_START + length) & 0xFF);
-    eth_write_byte(ETXNDH, (ETH_REG_TX_START + length) >> 8);
+    return false;
+}
 
-    // Write per-packet control byte(0x00 means use macon3 settings)
+/**
+ * @function:   eth_flow_pause
+ * @param:      True to pause the link partner, false to resume.
+ * @brief:      Asserts or releases flow control.
+ */
+static void
+eth_flow_pause(bool pause)
+{
+    if(eth_flow_full_duplex) {
+        // Send pause frames until released by a zero pause time frame
+        eth_write_byte(EFLOCON, (pause) ? EFLOCON_FCEN1 : (EFLOCON_FCEN1 | EFLOCON_FCEN0));
+    } else {
+        // Jam the medium while paused
+        eth_write_byte(EFLOCON, (pause) ? EFLOCON_FCEN0 : 0x00);
+    }
+
+    if(pause) {
+        eth_stats.rx_pauses++;
+    }
+
+    eth_flow_paused = pause;
+}
+
+/**
+ * @function:   eth_flow_update
+ * @param:      Current receive buffer occupancy.
+ * @brief:      Pauses or resumes the link partner when the receive
+ *              buffer passes one of the flow control watermarks.
+ */
+static void
+eth_flow_update(uint16_t occupancy)
+{
+    if(!eth_flow_enabled) {
+        return;
+    }
+
+    // Also called from the interrupt routine
+    eth_lock();
+
+    if(!eth_flow_paused && (occupancy > ETH_FLOW_HIGH_WATER)) {
+        eth_flow_pause(true);
+    } else if(eth_flow_paused && (occupancy < ETH_FLOW_LOW_WATER)) {
+        eth_flow_pause(false);
+    }
+
+    eth_unlock();
+}
+
+/**
+ * @function:   eth_set_flow_control
+ * @param:      True to enable flow control.
+ * @brief:      Pauses the link partner while the receive buffer is
+ *              filled above ETH_FLOW_HIGH_WATER, until it drops below
+ *              ETH_FLOW_LOW_WATER. Pause frames are used in full
+ *              duplex mode, backpressure in half duplex mode.
+ */
+void
+eth_set_flow_control(bool enable)
+{
+    // The flow control state is also updated by the interrupt routine
+    eth_lock();
+
+    // Release the link partner
+    if(eth_flow_paused) {
+        eth_flow_pause(false);
+    }
+
+    // Pause frames are only allowed in full duplex mode
+    if(enable) {
+        eth_flow_full_duplex = eth_is_full_duplex();
+    }
+
+    eth_flow_enabled = enable;
+
+    eth_unlock();
+}
+
+/**
+ * @function:   eth_get_stats
+ * @param:      Structure the statistics are copied to.
+ * @brief:      Returns a snapshot of the controller statistics.
+ */
+void
+eth_get_stats(struct eth_stats_t* stats)
+{
+    // The counters are updated by the interrupt routine
+    eth_lock();
+
+    memcpy(stats, &eth_stats, sizeof(struct eth_stats_t));
+
+    eth_unlock();
+}
+
+/**
+ * @function:   eth_get_events
+ * @return:     Mask of ETH_EVENT_* flags.
+ * @brief:      Returns and clears the events gathered by the
+ *              controller interrupt since the last call. When
+ *              no events are pending the controller does not
+ *              need to be accessed at all.
+ */
+uint8_t
+eth_get_events(void)
+{
+    uint8_t events;
+    uint8_t sreg = SREG;
+
+    // Events are raised by the controller interrupt
+    cli();
+
+    events = eth_events;
+    eth_events = 0;
+
+    SREG = sreg;
+
+    return events;
+}
+
+/**
+ * @function:   eth_enable_interrupt
+ * @brief:      Re-arms the controller interrupt line and the
+ *              receive interrupt after the pending events have
+ *              been handled. Events that are still pending will
+ *              trigger a new interrupt.
+ */
+void
+eth_enable_interrupt(void)
+{
+    eth_write_opcode(ENC28J60_BIT_FIELD_SET, EIE, EIE_INTIE | EIE_PKTIE);
+}
+
+/**
+ * @function:   eth_read_byte
+ * @param:      Register address to be read.
+ * @return:     Byte of data read from the controller.
+ * @brief:      Reads a byte of 8 bits from the ethernet controller.
+ */
+uint8_t
+eth_read_byte(uint8_t address)
+{
+    // Set the bank, the common registers are in all of them
+    if((address & ADDR_MASK) < EIE) {
+        eth_set_bank(address);
+    }
+
+    // Read the data form controller
+    return eth_read_opcode(ENC28J60_READ_CTRL_REG, address);
+}
+
+/**
+ * @function:   eth_write_byte
+ * @param:      Register address to be written.
+ * @param:      Byte of data to be send to the controller.
+ * @brief:      Writes a byte of 8 bits to the ethernet controller.
+ */
+void
+eth_write_byte(uint8_t address, uint8_t data)
+{
+    // Set the bank, the common registers are in all of them
+    if((address & ADDR_MASK) < EIE) {
+        eth_set_bank(address);
+    }
+
+    // Write data to controller
+    eth_write_opcode(ENC28J60_WRITE_CTRL_REG, address, data);
+}
+
+/**
+ * @function:   eth_write_list
+ * @param:      List of register writes.
+ * @param:      Number of writes in the list.
+ * @param:      True when the list is held in program memory.
+ * @brief:      Writes a list of control registers grouped by bank,
+ *              for eth_write_batch and eth_write_batch_P.
+ */
+static void
+eth_write_list(const struct eth_reg_write_t* writes, uint8_t count, bool progmem)
+{
+    uint8_t bank = eth_bank_pointer;
+    uint8_t pending = count;
+    uint8_t address, data;
+    uint8_t i, n;
+
+    // One pass per bank, the common registers are written in the first
+    for(n = 0; (n < 4) && pending; n++, bank = (bank + 0x20) & BANK_MASK) {
+        for(i = 0; i < count; i++) {
+            if(progmem) {
+                address = pgm_read_byte(&writes[i].address);
+            } else {
+                address = writes[i].address;
+            }
+
+            if((address & ADDR_MASK) >= EIE) {
+                if(n != 0) {
+                    continue;
+                }
+            } else if((address & BANK_MASK) != bank) {
+                continue;
+            }
+
+            if(progmem) {
+                data = pgm_read_byte(&writes[i].data);
+            } else {
+                data = writes[i].data;
+            }
+
+            eth_write_byte(address, data);
+            pending--;
+        }
+    }
+}
+
+/**
+ * @function:   eth_write_batch
+ * @param:      List of register writes.
+ * @param:      Number of writes in the list.
+ * @brief:      Writes a list of control registers grouped by bank,
+ *              starting with the bank already selected, so every
+ *              bank is switched to at most once. Writes to the same
+ *              bank keep their order, writes to the registers common
+ *              to all banks(EIE to ECON1) go first.
+ */
+void
+eth_write_batch(const struct eth_reg_write_t* writes, uint8_t count)
+{
+    eth_write_list(writes, count, false);
+}
+
+/**
+ * @function:   eth_write_batch_P
+ * @param:      List of register writes in program memory.
+ * @param:      Number of writes in the list.
+ * @brief:      Same as eth_write_batch, for a list of writes kept
+ *              in program memory.
+ */
+void
+eth_write_batch_P(const struct eth_reg_write_t* writes, uint8_t count)
+{
+    eth_write_list(writes, count, true);
+}
+
+/**
+ * @function:   eth_write_pointer
+ * @param:      Address of the low byte of the pointer register.
+ * @param:      Value to be written.
+ * @param:      Shadow copy of the pointer register.
+ * @brief:      Writes a 16 bit pointer register, skipping the bytes
+ *              already holding the value.
+ */
+static void
+eth_write_pointer(uint8_t address, uint16_t value, uint16_t* shadow)
+{
+    uint16_t changed = value ^ *shadow;
+
+    // The controller takes a new low byte of ERXRDPT over only when
+    // the high byte is written.
+    if((address == ERXRDPTL) && (changed & 0x00FF)) {
+        changed |= 0xFF00;
+    }
+
+    if(changed & 0x00FF) {
+        eth_write_byte(address, value & 0xFF);
+    }
+
+    if(changed & 0xFF00) {
+        eth_write_byte(address + 1, value >> 8);
+    }
+
+    *shadow = value;
+}
+
+/**
+ * @function:   eth_read_phy_h
+ * @param:      PHY register address to be read.
+ * @param:      Word of data read from the PHY register.
+ * @brief:      Reads the high byte of a 16 bit PHY register located
+ *              at the ethernet controller.
+ */
+uint16_t
+eth_read_phy_h(uint8_t address)
+{
+    uint16_t result;
+
+    SPI_STATS_BEGIN(SPI_STATS_PHY);
+
+    // Select register address
+    eth_write_byte(MIREGADR, address);
+
+    // Start the register read operation
+    eth_write_byte(MICMD, MICMD_MIIRD);
+
+    // Wait until the PHY read completes
+    _delay_us(15);
+
+    while(eth_read_byte(MISTAT) & MISTAT_BUSY);
+
+    // Reset reading bit
+    eth_write_byte(MICMD, 0x00);
+
+    // Read the actual byte and return
+    result = (uint16_t)(eth_read_byte(MIRDH) << 8);
+
+    SPI_STATS_END();
+
+    return result;
+}
+
+/**
+ * @function:   eth_write_phy
+ * @param:      PHY register address to be written.
+ * @param:      Word of data to be send to the PHY register.
+ * @brief:      Writes a word of 16 bits to the PHY register located
+ *              at the ethernet controller.
+ */
+void
+eth_write_phy(uint8_t address, uint16_t data)
+{
+    SPI_STATS_BEGIN(SPI_STATS_PHY);
+
+    // Set the PHY register address
+    eth_write_byte(MIREGADR, address);
+
+    // Write the PHY data
+    eth_write_byte(MIWRL, data);
+    eth_write_byte(MIWRH, data >> 8);
+
+    // Wait until the PHY write completes
+    while(eth_read_byte(MISTAT) & MISTAT_BUSY) {
+        _delay_us(15);
+    }
+
+    SPI_STATS_END();
+}
+
+#ifdef WITH_SPI_STATS
+/**
+ * @function:   eth_stats_class
+ * @param:      Operation instruction code.
+ * @return:     Statistics class of the operation(SPI_STATS_*).
+ */
+static uint8_t
+eth_stats_class(uint8_t opcode)
+{
+    switch(opcode) {
+        case ENC28J60_READ_CTRL_REG:
+            return SPI_STATS_REG_READ;
+
+        case ENC28J60_READ_BUF_MEM:
+            return SPI_STATS_BUF_READ;
+
+        case ENC28J60_WRITE_BUF_MEM:
+            return SPI_STATS_BUF_WRITE;
+
+        default:
+            return SPI_STATS_REG_WRITE;
+    }
+}
+#endif
+
+/**
+ * @function:   eth_read_opcode
+ * @param:      Operation instruction code.
+ * @param:      Involving register address.
+ * @return:     Byte of data read from the controller.
+ * @brief:      Write an operation to the controller following an
+ *              8 bit read containing the result of the operation.
+ */
+uint8_t
+eth_read_opcode(uint8_t opcode, uint8_t address)
+{
+    uint8_t result = 0;
+
+    // Check if the SPI interface is avaiable
+    spi_wait();
+
+    SPI_STATS_BEGIN(eth_stats_class(opcode));
+
+    // Select controller
+    eth_select();
+
+    // Issue read command
+    spi_write_byte(opcode | (address & ADDR_MASK));
+
+    // Read data
+    result = spi_read_byte();
+
+    // Do dummy read if needed(for mac and mii, see datasheet page 29)
+    if(address & 0x80) {
+        result = spi_read_byte();
+    }
+
+    // Deselect controller
+    eth_deselect();
+
+    SPI_STATS_COUNT((address & 0x80) ? 3 : 2);
+    SPI_STATS_END();
+
+    return (result);
+}
+
+/**
+ * @function:   eth_write_opcode
+ * @param:      Operation instruction code.
+ * @param:      Involving register address.
+ * @param:      Byte of data to be send to the controller.
+ * @brief:      Write an opcode to the controller.
+ */
+void
+eth_write_opcode(uint8_t opcode, uint8_t address, uint8_t data)
+{
+    // Check if the SPI interface is avaiable
+    spi_wait();
+
+    SPI_STATS_BEGIN(eth_stats_class(opcode));
+
+    // Select controller
+    eth_select();
+
+    // Issue write command
+    spi_write_byte(opcode | (address & ADDR_MASK));
+
+    // Write data
+    spi_write_byte(data);
+
+    // Deselect controller
+    eth_deselect();
+
+    SPI_STATS_COUNT(2);
+    SPI_STATS_END();
+}
+
+/**
+ * @function:   eth_read_buffer
+ * @param:      Lenght of data to be read from the memory.
+ * @param:      Local data buffer to be written to.
+ * @brief:      Reads a chunk of data from the memory located
+ *              in the ethernet controller.
+ */
+void
+eth_read_buffer(uint16_t length, uint8_t* data)
+{
+    // Check if the SPI interface is avaiable
+    spi_wait();
+
+    SPI_STATS_BEGIN(SPI_STATS_BUF_READ);
+
+    // Select controller
+    eth_select();
+
+    // Issue read command
+    spi_write_byte(ENC28J60_READ_BUF_MEM);
+
+    // Read data
+    spi_read_block(length, data);
+
+    // Skip to the end of the chunk
+    data += length;
+
+    // Add string delimiter
+    *data = '\0';
+
+    // Deselect controller
+    eth_deselect();
+
+    SPI_STATS_COUNT(1 + length);
+    SPI_STATS_END();
+}
+
+/**
+ * @function:   eth_write_buffer
+ * @param:      Lenght of data to be written to the memory.
+ * @param:      Local data buffer to be read from.
+ * @brief:      Write a chunk of data to the memory located
+ *              in the ethernet controller.
+ */
+void
+eth_write_buffer(uint16_t length, uint8_t* data)
+{
+    // Check if the SPI interface is avaiable
+    spi_wait();
+
+    SPI_STATS_BEGIN(SPI_STATS_BUF_WRITE);
+
+    // Select controller
+    eth_select();
+
+    // Issue write command
+    spi_write_byte(ENC28J60_WRITE_BUF_MEM);
+
+    // Write data
+    spi_write_block(length, data);
+
+    // Deselect controller
+    eth_deselect();
+
+    SPI_STATS_COUNT(1 + length);
+    SPI_STATS_END();
+}
+
+/**
+ * @function:   eth_rx_address
+ * @param:      Offset from the start of the received packet.
+ * @return:     Controller memory address of the offset.
+ * @brief:      Translates a packet offset into a receive buffer
+ *              address, wrapping around the end of the buffer.
+ */
+static uint16_t
+eth_rx_address(uint16_t offset)
+{
+    // Skip the next packet pointer and receive status vector
+    uint16_t address = eth_frame_pointer + 6 + offset;
+
+    // Wrap around the end of the receive buffer
+    if(address > ETH_REG_RX_STOP) {
+        address -= ETH_RX_BUFFER_SIZE;
+    }
+
+    return address;
+}
+
+/**
+ * @function:   eth_tx_start
+ * @param:      Transmit slot to be sent.
+ * @brief:      Starts the transmission of a filled transmit slot.
+ */
+static void
+eth_tx_start(uint8_t slot)
+{
+    uint16_t address = ETH_TX_SLOT(slot);
+
+    // Set the TXST pointer to the control byte of the slot
+    eth_write_pointer(ETXSTL, address, &eth_shadow_etxst);
+
+    // Set the TXND pointer to correspond to the packet size given
+    eth_write_pointer(ETXNDL, address + eth_tx_length[slot], &eth_shadow_etxnd);
+
+    // Send the contents of the slot onto the network
+    eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRTS);
+}
+
+#ifdef WITH_ETH_TX_STATUS
+/**
+ * @function:   eth_tx_status
+ * @param:      Transmit slot of the completed frame.
+ * @return:     True when the frame should be sent again.
+ * @brief:      Reads the transmit status vector the controller
+ *              wrote behind the frame and updates the transmit
+ *              statistics. Frames lost to a late collision are
+ *              retried up to ETH_TX_RETRIES times.
+ */
+static bool
+eth_tx_status(uint8_t slot)
+{
+    uint16_t address = ETH_TX_SLOT(slot) + eth_tx_length[slot] + 1;
+    uint8_t tsv[TSV_LENGTH + 1];
+    uint8_t status;
+
+    status = eth_read_opcode(ENC28J60_READ_CTRL_REG, ESTAT);
+
+    // The read pointer is shared with the receive path
+    eth_lock();
+
+    // The vector follows the last byte of the frame(ETXND)
+    eth_write_byte(ERDPTL, address & 0xFF);
+    eth_write_byte(ERDPTH, address >> 8);
+
+    eth_read_buffer(TSV_LENGTH, tsv);
+
+    eth_unlock();
+
+    eth_stats.tx_collisions += tsv[2] & TSV2_COLCNT;
+
+    if(tsv[3] & TSV3_DEFER) {
+        eth_stats.tx_deferrals++;
+    }
+
+    // The late collision and abort flags have to be cleared
+    if(status & (ESTAT_LATECOL | ESTAT_TXABRT)) {
+        eth_write_opcode(ENC28J60_BIT_FIELD_CLR, ESTAT, ESTAT_LATECOL | ESTAT_TXABRT);
+    }
+
+    // The controller does not retry a frame hit by a late
+    // collision(see silicon errata).
+    if((status & ESTAT_LATECOL) || (tsv[3] & TSV3_LATECOL)) {
+        eth_stats.tx_late_collisions++;
+
+        if(eth_tx_retries < ETH_TX_RETRIES) {
+            eth_stats.tx_retries++;
+            eth_tx_retries++;
+
+            return true;
+        }
+    }
+
+    if(status & ESTAT_TXABRT) {
+        eth_stats.tx_aborts++;
+    }
+
+    eth_tx_retries = 0;
+
+    return false;
+}
+#endif
+
+/**
+ * @function:   eth_tx_periodic
+ * @brief:      Frees the transmit slot of a completed frame and
+ *              starts the next queued one. Call this on every
+ *              ETH_EVENT_TX event.
+ */
+void
+eth_tx_periodic(void)
+{
+    // Nothing in flight
+    if(eth_tx_count == 0) {
+        return;
+    }
+
+    // Check if transmit is in progress
+    if(eth_read_opcode(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_TXRTS) {
+        // Still busy?
+        if(!(eth_read_byte(EIR) & EIR_TXERIF)) {
+            return;
+        }
+
+        // Reset the transmit logic problem. See Rev. B4 Silicon Errata point 12.
+        eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRST);
+        eth_write_opcode(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRST);
+    }
+
+    // Clear a possible transmit error
+    eth_write_opcode(ENC28J60_BIT_FIELD_CLR, EIR, EIR_TXERIF);
+
+#ifdef WITH_ETH_TX_STATUS
+    // Send the frame again, keeping its slot
+    if(eth_tx_status(eth_tx_tail)) {
+        eth_tx_start(eth_tx_tail);
+        return;
+    }
+#endif
+
+    // Free the slot
+    eth_tx_tail = (eth_tx_tail + 1) % ETH_TX_SLOTS;
+    eth_tx_count--;
+
+    // Start the next queued frame
+    if(eth_tx_count) {
+        eth_tx_start(eth_tx_tail);
+    }
+}
+
+/**
+ * @function:   eth_tx_acquire
+ * @return:     Start address of a free transmit slot.
+ * @brief:      Returns the next free transmit slot, waiting for
+ *              a transmission to complete when all are in use.
+ */
+static uint16_t
+eth_tx_acquire(void)
+{
+    // Collect a completed transmission
+    eth_tx_periodic();
+
+    // Wait until a slot is free
+    while(eth_tx_count == ETH_TX_SLOTS) {
+        eth_tx_periodic();
+    }
+
+    return ETH_TX_SLOT(eth_tx_head);
+}
+
+/**
+ * @function:   eth_tx_commit
+ * @param:      Lenght of the packet written to the slot.
+ * @brief:      Queues the slot returned by eth_tx_acquire for
+ *              transmission, starting it when the transmitter
+ *              is idle.
+ */
+static void
+eth_tx_commit(uint16_t length)
+{
+    eth_tx_length[eth_tx_head] = length;
+    eth_tx_head = (eth_tx_head + 1) % ETH_TX_SLOTS;
+
+    if(eth_tx_count++ == 0) {
+        eth_tx_start(eth_tx_tail);
+    }
+}
+
+/**
+ * @function:   eth_tx_write
+ * @param:      List of fragments to be written.
+ * @param:      Number of fragments in the list.
+ * @return:     Lenght of the fragments written.
+ * @brief:      Writes the per-packet control byte followed by the
+ *              fragments at the write pointer, all in one buffer
+ *              memory write.
+ */
+static uint16_t
+eth_tx_write(const struct eth_fragment_t* fragments, uint8_t count)
+{
+    uint16_t length = 0;
+    uint16_t i;
+
+    // Check if the SPI interface is avaiable
+    spi_wait();
+
+    SPI_STATS_BEGIN(SPI_STATS_BUF_WRITE);
+
+    // Select controller
+    eth_select();
+
+    // Issue write command
+    spi_write_byte(ENC28J60_WRITE_BUF_MEM);
+
+    // Write per-packet control byte(0x00 means use macon3 settings)
+    spi_write_byte(0x00);
+
+    // Stream the fragments in order
+    for(; count > 0; count--, fragments++) {
+        if(fragments->flags & ETH_FRAGMENT_PGM) {
+            for(i = 0; i < fragments->length; i++) {
+                spi_write_byte(pgm_read_byte(fragments->data + i));
+            }
+        } else {
+            spi_write_block(fragments->length, fragments->data);
+        }
+
+        length += fragments->length;
+    }
+
+    // Deselect controller
+    eth_deselect();
+
+    SPI_STATS_COUNT(2 + length);
+    SPI_STATS_END();
+
+    return length;
+}
+
+/**
+ * @function:   eth_tx_checksum
+ * @param:      Offset from the start of the transmit frame.
+ * @param:      Number of bytes to be summed.
+ * @return:     Internet checksum of the frame range.
+ * @brief:      Calculates the checksum over a part of the frame
+ *              written to the transmit slot returned by the last
+ *              eth_tx_acquire call, before it is committed.
+ */
+static uint16_t
+eth_tx_checksum(uint16_t offset, uint16_t length)
+{
+    // Skip the per-packet control byte
+    return eth_checksum(ETH_TX_SLOT(eth_tx_head) + 1 + offset, length);
+}
+
+/**
+ * @function:   eth_tx_finish
+ * @param:      Lenght of the frame written to the slot.
+ * @param:      Checksum to be filled in, or NULL.
+ * @brief:      Fills in the checksum of a frame written to the
+ *              transmit slot, then queues the slot for transmission.
+ */
+static void
+eth_tx_finish(uint16_t length, const struct eth_checksum_t* checksum)
+{
+    uint16_t address;
+    uint32_t sum;
+    uint8_t field[2];
+
+    if(checksum && (checksum->start < length) && (checksum->field + 2 <= length)) {
+        // Sum of the frame, the checksum field is still zero
+        sum = (uint16_t) ~eth_tx_checksum(checksum->start, length - checksum->start);
+        sum += checksum->sum;
+
+        // Take only 16 bits out of the 32 bit sum and add up the carries
+        while(sum >> 16) {
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        }
+
+        // One's complement the result, zero means no checksum for UDP
+        sum = (uint16_t) ~sum;
+
+        if(sum == 0) {
+            sum = 0xFFFF;
+        }
+
+        field[0] = sum >> 8;
+        field[1] = sum & 0xFF;
+
+        // Write the field behind the control byte
+        address = ETH_TX_SLOT(eth_tx_head) + 1 + checksum->field;
+
+        eth_write_byte(EWRPTL, address & 0xFF);
+        eth_write_byte(EWRPTH, address >> 8);
+
+        eth_write_buffer(sizeof(field), field);
+    }
+
+    eth_tx_commit(length);
+}
+
+/**
+ * @function:   eth_send_packet
+ * @param:      Lenght of the packet to be send.
+ * @param:      Local packet buffer to be read from.
+ * @brief:      Sends an ethernet packet to the ethernet controller.
+ *              The packet is queued in a free transmit slot, this
+ *              only blocks when all slots are still in flight.
+ */
+void
+eth_send_packet(uint16_t length, uint8_t* packet)
+{
+    struct eth_fragment_t fragment = {packet, length, 0};
+
+    // Copy the control byte and the packet into the transmit slot
+    eth_send_fragments(&fragment, 1);
+}
+
+/**
+ * @function:   eth_send_reply
+ * @param:      Lenght of the reply to be send.
+ * @param:      Lenght of the reply header.
+ * @param:      Local buffer holding the reply header.
+ * @param:      Checksum to be calculated over the reply once it
+ *              is in the transmit slot, or NULL.
+ * @brief:      Sends a reply built from the packet returned by the
+ *              last eth_peek_packet call. Only the header is written
+ *              over SPI, the rest of the reply is copied from the
+ *              received packet by the controller DMA. When frames
+ *              are received from the ring(WITH_ETH_RX_ISR) the
+ *              header and the rest of the ring slot are gathered
+ *              into the transmit slot.
+ */
+void
+eth_send_reply(uint16_t length, uint16_t header_length, uint8_t* header, const struct eth_checksum_t* checksum)
+{
+    uint16_t address = eth_tx_acquire();
+#ifdef WITH_ETH_RX_ISR
+    uint8_t slot = eth_rx_ring_tail % ETH_RX_RING_SLOTS;
+    struct eth_fragment_t fragments[2];
+
+    // Never send more than was received, the rest of the
+    // slot holds stale data of older frames.
+    if(length > eth_rx_ring_length[slot]) {
+        length = eth_rx_ring_length[slot];
+    }
+
+    // Limit the header to the reply
+    if(header_length > length) {
+        header_length = length;
+    }
+
+    // The frame is no longer held by the controller, the reply
+    // header is followed by the rest of the frame in the slot.
+    fragments[0].data = header;
+    fragments[0].length = header_length;
+    fragments[0].flags = 0;
+
+    fragments[1].data = eth_rx_ring[slot] + header_length;
+    fragments[1].length = length - header_length;
+    fragments[1].flags = 0;
+
+    // Set the write pointer to start of the transmit slot
+    eth_write_byte(EWRPTL, address & 0xFF);
+    eth_write_byte(EWRPTH, address >> 8);
+
+    eth_tx_write(fragments, 2);
+#else
+    struct eth_fragment_t fragment;
+    uint16_t start, end;
+
+    // Never send more than was received, the receive buffer
+    // behind the frame holds other frames.
+    if(length > eth_frame_length) {
+        length = eth_frame_length;
+    }
+
+    // Limit the header to the reply
+    if(header_length > length) {
+        header_length = length;
+    }
+
+    // Copy the unchanged part of the received packet
+    if(length > header_length) {
+        start = eth_rx_address(header_length);
+        end = eth_rx_address(length - 1);
+
+        // Copy behind the control byte and reply header, the DMA
+        // wraps at the end of the receive buffer
+        eth_dma_copy(address + 1 + header_length, start, end);
+    }
+
+    // Set the write pointer to start of the transmit slot
+    eth_write_byte(EWRPTL, address & 0xFF);
+    eth_write_byte(EWRPTH, address >> 8);
+
+    // Copy the control byte and the reply header into the transmit slot
+    fragment.data = header;
+    fragment.length = header_length;
+    fragment.flags = 0;
+
+    eth_tx_write(&fragment, 1);
+#endif
+
+    // Fill in the checksum and queue the slot for transmission
+    eth_tx_finish(length, checksum);
+}
+
+/**
+ * @function:   eth_send_fragments
+ * @param:      List of fragments making up the packet.
+ * @param:      Number of fragments in the list.
+ * @brief:      Sends a packet gathered from several buffers, e.g. a
+ *              header template in program memory, the payload and a
+ *              trailer. The fragments are streamed into the transmit
+ *              slot in order, so the packet never has to be assembled
+ *              in RAM. The buffers may be reused when this returns.
+ */
+void
+eth_send_fragments(const struct eth_fragment_t* fragments, uint8_t count)
+{
+    uint16_t address = eth_tx_acquire();
+    uint16_t length;
+
+    // Set the write pointer to start of the transmit slot
+    eth_write_byte(EWRPTL, address & 0xFF);
+    eth_write_byte(EWRPTH, address >> 8);
+
+    // Copy the control byte and the fragments into the transmit slot
+    length = eth_tx_write(fragments, count);
+
+    // Queue the slot for transmission
+    eth_tx_commit(length);
+}
+
+/**
+ * @function:   eth_send_memory
+ * @param:      Controller memory address of the packet.
+ * @param:      Lenght of the packet to be send.
+ * @brief:      Sends a packet held in controller memory outside
+ *              the receive buffer, e.g. an xmem buffer. The packet
+ *              is copied into a transmit slot by the controller DMA.
+ */
+void
+eth_send_memory(uint16_t address, uint16_t length)
+{
+    uint16_t slot;
+
+    if(length == 0) {
+        return;
+    }
+
+    slot = eth_tx_acquire();
+
+    // Copy the packet behind the control byte
+    eth_dma_copy(slot + 1, address, address + length - 1);
+
+    // Set the write pointer to start of the transmit slot
+    eth_write_byte(EWRPTL, slot & 0xFF);
+    eth_write_byte(EWRPTH, slot >> 8);
+
+    // Write per-packet control byte(0x00 means use macon3 settings)
     eth_write_opcode(ENC28J60_WRITE_BUF_MEM, 0, 0x00);
 
-    // Copy the packet into the transmit buffer
-    eth_write_buffer(length, packet);
+    // Queue the slot for transmission
+    eth_tx_commit(length);
+}
 
-    // Send the contents of the transmit buffer onto the network
-    eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRTS);
+/**
+ * @function:   eth_dma_copy
+ * @param:      Controller memory address of the destination.
+ * @param:      Controller memory address of the first byte.
+ * @param:      Controller memory address of the last byte.
+ * @brief:      Copies a range of controller memory using the DMA
+ *              and waits until it completes. A range ending before
+ *              it starts wraps around the end of the receive buffer.
+ */
+void
+eth_dma_copy(uint16_t destination, uint16_t start, uint16_t end)
+{
+    // Source range and destination
+    const struct eth_reg_write_t writes[] = {
+        {EDMASTL,  start & 0xFF},
+        {EDMASTH,  start >> 8},
+        {EDMANDL,  end & 0xFF},
+        {EDMANDH,  end >> 8},
+        {EDMADSTL, destination & 0xFF},
+        {EDMADSTH, destination >> 8}
+    };
+
+    eth_write_batch(writes, sizeof(writes) / sizeof(writes[0]));
+
+    // Start the copy and wait until it completes
+    eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_DMAST);
+
+    while(eth_read_opcode(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_DMAST);
+}
+
+/**
+ * @function:   eth_rx_reset
+ * @brief:      Drops all received packets and restarts the receive
+ *              logic at the start of the receive buffer. Used when
+ *              the packet pointers in the buffer are corrupted.
+ */
+static void
+eth_rx_reset(void)
+{
+    // Stop packet reception and reset the receive logic
+    eth_write_opcode(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_RXEN);
+    eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_RXRST);
+    eth_write_opcode(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_RXRST);
+
+    // Drop all pending packets
+    while(eth_read_byte(EPKTCNT)) {
+        eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON2, ECON2_PKTDEC);
+    }
+
+    eth_rx_count = 0;
+
+    // Restart at the start of the receive buffer, writing
+    // ERXST also resets the hardware write pointer.
+    eth_packet_pointer = ETH_REG_RX_START;
+    eth_frame_pointer = ETH_REG_RX_START;
+
+    eth_write_batch_P(eth_rx_reset_table, sizeof(eth_rx_reset_table) / sizeof(eth_rx_reset_table[0]));
+
+    eth_shadow_erxrdpt = ETH_REG_RX_START;
+
+    // Enable packet reception
+    eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_RXEN);
+
+    // Nothing left to pause for
+    if(eth_flow_paused) {
+        eth_flow_pause(false);
+    }
+
+    eth_stats.rx_resets++;
 }
 
 /**
@@ -533,70 +1823,605 @@ eth_send_packet(uint16_t length, uint8_t* packet)
  * @param:      Maximum lenght of the packet to be read.
  * @param:      Local packet buffer to be written to.
  * @brief:      Reads a pending ethernet packet from the ethernet controller.
+ *              The packet must be freed using eth_release_packet.
  */
 uint16_t
 eth_receive_packet(uint16_t max_length, uint8_t* packet)
 {
+    uint16_t length = eth_peek_packet(max_length - 1, packet);
+
+    // Limit retrieve length
+    if(length > max_length - 1) {
+        length = max_length - 1;
+
+        eth_stats.rx_truncated++;
+    }
+
+    return(length);
+}
+
+/**
+ * @function:   eth_peek_packet
+ * @param:      Number of bytes to be read from the packet start.
+ * @param:      Local packet buffer to be written to, should hold
+ *              one more byte than requested.
+ * @return:     Full length of the packet, zero when invalid.
+ * @brief:      Reads only the first part of a pending ethernet packet,
+ *              the rest can be read on demand using eth_read_packet.
+ *              The packet must be freed using eth_release_packet.
+ */
+uint16_t
+eth_peek_packet(uint16_t peek_length, uint8_t* packet)
+{
+    uint16_t occupancy = 0;
     uint16_t rxstatus = 0;
     uint16_t length = 0;
+    uint8_t status[6];
+    bool corrupt;
 
     // Check if a packet has been received and buffered
     if(eth_get_rx_packet_count() == 0) { // See Rev. B4 Silicon Errata point 6.
         return 0;
     }
 
+    // Keep the start of this packet until it is released
+    eth_frame_pointer = eth_packet_pointer;
+    eth_frame_length = 0;
+
+    // Arrival time, set by the interrupt routine. The stamp belongs
+    // to the first packet of a burst only, the packets behind it
+    // are stamped now rather than with an older arrival time.
+    eth_lock();
+
+    if(eth_rx_stamp_fresh) {
+        eth_frame_stamp = eth_rx_stamp;
+        eth_rx_stamp_fresh = false;
+    } else {
+        clock_get_stamp(&eth_frame_stamp);
+    }
+
+    eth_unlock();
+
+    // Record the receive buffer high-water mark
+    if((occupancy = eth_get_rx_occupancy()) > eth_stats.rx_high_water) {
+        eth_stats.rx_high_water = occupancy;
+    }
+
+    // Pause the link partner when running out of space
+    eth_flow_update(occupancy);
+
     // Set the read pointer to the start of the received packet
     eth_write_byte(ERDPTL, (eth_packet_pointer & 0xFF));
     eth_write_byte(ERDPTH, (eth_packet_pointer) >> 8);
 
-    // Read the next packet pointer
-    eth_packet_pointer  = eth_read_opcode(ENC28J60_READ_BUF_MEM, 0);
-    eth_packet_pointer |= eth_read_opcode(ENC28J60_READ_BUF_MEM, 0) << 8;
+    // Check if the SPI interface is avaiable
+    spi_wait();
 
-    // Read the packet length(see datasheet page 43)
-    length  = eth_read_opcode(ENC28J60_READ_BUF_MEM, 0);
-    length |= eth_read_opcode(ENC28J60_READ_BUF_MEM, 0) << 8;
+    SPI_STATS_BEGIN(SPI_STATS_BUF_READ);
 
-    // Remove the CRC count
-    length -= 4;
+    // Select controller
+    eth_select();
 
-    // Read the receive status(see datasheet page 43)
-    rxstatus  = eth_read_opcode(ENC28J60_READ_BUF_MEM, 0);
-    rxstatus |= ((uint16_t) eth_read_opcode(ENC28J60_READ_BUF_MEM, 0)) << 8;
+    // Issue read command, the status vector and the headers
+    // are read in one go.
+    spi_write_byte(ENC28J60_READ_BUF_MEM);
 
-    // Limit retrieve length
-    if(length > max_length - 1) {
-        length = max_length - 1;
+    // Read the next packet pointer, packet length and receive
+    // status(see datasheet page 43)
+    spi_read_block(sizeof(status), status);
+
+    eth_packet_pointer = status[0] | (status[1] << 8);
+    length = (status[2] | (status[3] << 8)) - 4;        // Remove the CRC count
+    rxstatus = status[4] | (status[5] << 8);
+
+    // A next packet pointer outside the receive buffer, or a packet
+    // larger than the controller accepts(MAMXFL, CRC included), means
+    // the buffer is corrupt.
+    corrupt = (eth_packet_pointer > ETH_REG_RX_STOP) || (eth_packet_pointer & 0x01) ||
+              (length > ETH_MAX_FRAME_LENGTH - 4);
+
+    // Copy the headers of a valid packet from the receive buffer
+    if(corrupt || ((rxstatus & 0x80) == 0)) {
+        peek_length = 0;
+    } else if(peek_length > length) {
+        peek_length = length;
+    }
+
+    spi_read_block(peek_length, packet);
+
+    // Deselect controller
+    eth_deselect();
+
+    SPI_STATS_COUNT(1 + sizeof(status) + peek_length);
+    SPI_STATS_END();
+
+    // Add string delimiter
+    packet[peek_length] = '\0';
+
+    if(corrupt) {
+        eth_rx_reset();
+        return 0;
     }
 
     // Check CRC and symbol errors(see datasheet page 44, table 7-3):
     // The ERXFCON.CRCEN is set by default. Normally we should not
     // need to check this.
     if((rxstatus & 0x80) == 0) {
+        if(rxstatus & 0x10) {
+            eth_stats.rx_crc_errors++;
+        }
+
         // Invalid packet
-        length = 0;
-    } else {
-        // Copy the packet from the receive buffer
-        eth_read_buffer(length, packet);
+        return 0;
     }
 
-    // Move the RX read pointer to the start of the next received packet
-    eth_write_byte(ERXRDPTL, (eth_packet_pointer & 0xFF));
-    eth_write_byte(ERXRDPTH, (eth_packet_pointer >> 8));
+    eth_frame_length = length;
 
-    /* XXX: Two lines above can be deleted? */
+    return(length);
+}
+
+/**
+ * @function:   eth_read_packet
+ * @param:      Offset from the start of the received packet.
+ * @param:      Lenght of data to be read.
+ * @param:      Local data buffer to be written to.
+ * @brief:      Reads a part of the packet returned by the last
+ *              eth_peek_packet or eth_receive_packet call.
+ */
+void
+eth_read_packet(uint16_t offset, uint16_t length, uint8_t* data)
+{
+#ifdef WITH_ETH_RX_ISR
+    uint8_t slot = eth_rx_ring_tail % ETH_RX_RING_SLOTS;
+
+    // Limit to the frame held by the ring slot
+    if(offset > eth_rx_ring_length[slot]) {
+        offset = eth_rx_ring_length[slot];
+    }
+
+    if(length > eth_rx_ring_length[slot] - offset) {
+        length = eth_rx_ring_length[slot] - offset;
+    }
+
+    // Copy the data from the ring slot
+    memmove(data, eth_rx_ring[slot] + offset, length);
+
+    // Add string delimiter
+    data[length] = '\0';
+#else
+    uint16_t address = eth_rx_address(offset);
+
+    // Set the read pointer, it wraps at the end of the receive buffer
+    eth_write_byte(ERDPTL, (address & 0xFF));
+    eth_write_byte(ERDPTH, (address >> 8));
 
-    // See Rev. B4 Silicon Errata point 13.
+    // Copy the data from the receive buffer
+    eth_read_buffer(length, data);
+#endif
+}
+
+/**
+ * @function:   eth_get_rx_stamp
+ * @param:      Time point to be filled in.
+ * @brief:      Returns the arrival time of the packet returned by
+ *              the last eth_peek_packet, eth_receive_packet or
+ *              eth_rx_ring_get call: the moment the controller
+ *              interrupt announced it. Packets that were not
+ *              announced by an interrupt of their own, e.g. the
+ *              rest of a burst, carry the time they were read
+ *              from the controller instead.
+ */
+void
+eth_get_rx_stamp(struct clock_time_t* stamp)
+{
+#ifdef WITH_ETH_RX_ISR
+    *stamp = eth_rx_ring_stamp[eth_rx_ring_tail % ETH_RX_RING_SLOTS];
+#else
+    *stamp = eth_frame_stamp;
+#endif
+}
+
+/**
+ * @function:   eth_release_packet
+ * @brief:      Frees the memory of the packet last read by
+ *              eth_receive_packet. Until then the frame is kept
+ *              in the controller for eth_rx_checksum.
+ */
+void
+eth_release_packet(void)
+{
+    // Nothing received since the last release?
+    if(eth_frame_pointer == eth_packet_pointer) {
+        return;
+    }
+
+    // Free the packet, the read pointer has to be odd so it is
+    // set right before the next packet(see Rev. B4 Silicon Errata
+    // point 13).
     if(((eth_packet_pointer - 1) < ETH_REG_RX_START) || ((eth_packet_pointer - 1) > ETH_REG_RX_STOP)) {
-        eth_write_byte(ERXRDPTL, (ETH_REG_RX_STOP) & 0xFF);
-        eth_write_byte(ERXRDPTH, (ETH_REG_RX_STOP) >> 8);
+        eth_write_pointer(ERXRDPTL, ETH_REG_RX_STOP, &eth_shadow_erxrdpt);
     } else {
-        eth_write_byte(ERXRDPTL, (eth_packet_pointer - 1) & 0xFF);
-        eth_write_byte(ERXRDPTH, (eth_packet_pointer - 1) >> 8);
+        eth_write_pointer(ERXRDPTL, eth_packet_pointer - 1, &eth_shadow_erxrdpt);
     }
 
     // Decrement the packet counter indicate we are done with this packet
     eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON2, ECON2_PKTDEC);
 
-    return(length);
+    if(eth_rx_count) {
+        eth_rx_count--;
+    }
+
+    // Packet is gone
+    eth_frame_pointer = eth_packet_pointer;
+
+    // Resume the link partner once enough space is freed
+    if(eth_flow_paused) {
+        eth_flow_update(eth_get_rx_occupancy());
+    }
+}
+
+#ifdef WITH_ETH_RX_ISR
+/**
+ * @function:   eth_rx_drain
+ * @return:     True when all received frames have been moved,
+ *              false when the ring ran full.
+ * @brief:      Moves the frames received by the controller into
+ *              the frame ring, freeing them in the controller.
+ *              Called with the controller interrupt held off by
+ *              eth_lock, global interrupts may be enabled.
+ */
+static bool
+eth_rx_drain(void)
+{
+    uint16_t length;
+    uint8_t slot;
+
+    while(eth_get_rx_packet_count()) {
+        // Ring full, leave the frames in the controller
+        if((uint8_t)(eth_rx_ring_head - eth_rx_ring_tail) == ETH_RX_RING_SLOTS) {
+            return false;
+        }
+
+        slot = eth_rx_ring_head % ETH_RX_RING_SLOTS;
+
+        // Copy the whole frame into the slot
+        length = eth_peek_packet(ETH_RX_RING_FRAME_SIZE - 1, eth_rx_ring[slot]);
+
+        // Drop frames not fitting a slot
+        if(length > ETH_RX_RING_FRAME_SIZE - 1) {
+            eth_stats.rx_truncated++;
+            length = 0;
+        }
+
+        // Free the frame in the controller
+        eth_release_packet();
+
+        // Hand the frame over to the main loop, the length is
+        // stored before the head moves.
+        if(length) {
+            eth_rx_ring_stamp[slot] = eth_frame_stamp;
+            eth_rx_ring_length[slot] = length;
+            eth_rx_ring_head++;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @function:   eth_rx_ring_get
+ * @param:      Set to the ring slot holding the frame.
+ * @return:     Length of the oldest frame in the ring, zero when empty.
+ * @brief:      Returns the oldest frame received by the interrupt
+ *              routine. The slot may be modified in place and is
+ *              owned by the caller until eth_rx_ring_release.
+ */
+uint16_t
+eth_rx_ring_get(uint8_t** packet)
+{
+    uint8_t slot;
+
+    // Ring empty?
+    if(eth_rx_ring_tail == eth_rx_ring_head) {
+        return 0;
+    }
+
+    slot = eth_rx_ring_tail % ETH_RX_RING_SLOTS;
+
+    *packet = eth_rx_ring[slot];
+
+    return eth_rx_ring_length[slot];
+}
+
+/**
+ * @function:   eth_rx_ring_release
+ * @brief:      Hands the slot of the frame returned by the last
+ *              eth_rx_ring_get call back to the interrupt routine.
+ */
+void
+eth_rx_ring_release(void)
+{
+    if(eth_rx_ring_tail != eth_rx_ring_head) {
+        eth_rx_ring_tail++;
+    }
+}
+
+/**
+ * @function:   eth_ring_checksum
+ * @param:      Offset from the start of the frame.
+ * @param:      Number of bytes to be summed.
+ * @return:     Internet checksum of the frame range.
+ * @brief:      Calculates the checksum over a part of the frame
+ *              returned by eth_rx_ring_get, in the same format
+ *              as the DMA checksum engine.
+ */
+static uint16_t
+eth_ring_checksum(uint16_t offset, uint16_t length)
+{
+    uint8_t slot = eth_rx_ring_tail % ETH_RX_RING_SLOTS;
+    uint8_t* data = eth_rx_ring[slot] + offset;
+    uint32_t sum = 0;
+
+    // Limit to the frame held by the ring slot
+    if(offset > eth_rx_ring_length[slot]) {
+        return 0xFFFF;
+    }
+
+    if(length > eth_rx_ring_length[slot] - offset) {
+        length = eth_rx_ring_length[slot] - offset;
+    }
+
+    // Sum up all 16 bit words
+    for(; length > 1; length -= 2, data += 2) {
+        sum += (data[0] << 8) | data[1];
+    }
+
+    // Add the left over byte, padded with zero
+    if(length) {
+        sum += data[0] << 8;
+    }
+
+    // Take only 16 bits out of the 32 bit sum and add up the carries
+    while(sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    // One's complement the result
+    return (uint16_t)(~sum);
+}
+#endif
+
+/**
+ * @function:   eth_rx_poll
+ * @return:     True when frames are waiting in the controller.
+ * @brief:      Fallback for a lost receive interrupt(see Rev. B4
+ *              Silicon Errata point 6). Looks at EPKTCNT at most
+ *              once per ETH_RX_POLL_INTERVAL ms, call it when no
+ *              ETH_EVENT_RX was raised. With WITH_ETH_RX_ISR the
+ *              frames found are moved into the frame ring.
+ */
+bool
+eth_rx_poll(void)
+{
+    struct clock_time_t now;
+    int32_t elapsed;
+    bool pending;
+
+    clock_get_stamp(&now);
+
+    // Milliseconds since the last check, a clock set backwards
+    // gives a negative count and checks right away.
+    elapsed = (int32_t)(now.timestamp - eth_rx_poll_stamp.timestamp) * 1000 +
+              now.microtime - eth_rx_poll_stamp.microtime;
+
+    if((elapsed >= 0) && (elapsed < ETH_RX_POLL_INTERVAL)) {
+        return false;
+    }
+
+    eth_rx_poll_stamp = now;
+
+#ifdef WITH_ETH_RX_ISR
+    // Drain the frames the interrupt routine was not told about,
+    // only the controller interrupt is held off meanwhile.
+    eth_lock();
+
+    eth_rx_drain();
+    pending = (eth_rx_ring_head != eth_rx_ring_tail);
+
+    eth_unlock();
+#else
+    pending = (eth_get_rx_packet_count() != 0);
+#endif
+
+    return pending;
+}
+
+/**
+ * @function:   eth_checksum
+ * @param:      Controller memory address of the first byte.
+ * @param:      Number of bytes to be summed.
+ * @return:     Internet checksum of the memory range.
+ * @brief:      Calculates the one's complement checksum over
+ *              controller memory using the DMA checksum engine.
+ *              Ranges running past the end of the receive buffer
+ *              wrap around to its start.
+ */
+uint16_t
+eth_checksum(uint16_t address, uint16_t length)
+{
+    uint16_t end;
+    uint8_t busy;
+    uint8_t tries = 0;
+
+    // The checksum of nothing
+    if(length == 0) {
+        return 0xFFFF;
+    }
+
+    // Calculate the address of the last byte
+    end = address + length - 1;
+
+    if((address <= ETH_REG_RX_STOP) && (end > ETH_REG_RX_STOP)) {
+        end -= ETH_RX_BUFFER_SIZE;
+    }
+
+    // Set the DMA range
+    const struct eth_reg_write_t writes[] = {
+        {EDMASTL, address & 0xFF},
+        {EDMASTH, address >> 8},
+        {EDMANDL, end & 0xFF},
+        {EDMANDH, end >> 8}
+    };
+
+    eth_write_batch(writes, sizeof(writes) / sizeof(writes[0]));
+
+    // The result may be corrupted when a frame is received while
+    // the checksum is being calculated(see silicon errata), retry
+    // a few times when the receive logic was busy.
+    do {
+        busy = eth_read_opcode(ENC28J60_READ_CTRL_REG, ESTAT) & ESTAT_RXBUSY;
+
+        // Start the calculation and wait until it completes
+        eth_write_opcode(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_CSUMEN | ECON1_DMAST);
+
+        while(eth_read_opcode(ENC28J60_READ_CTRL_REG, ECON1) & ECON1_DMAST);
+
+        busy |= eth_read_opcode(ENC28J60_READ_CTRL_REG, ESTAT) & ESTAT_RXBUSY;
+    } while(busy && (++tries < ETH_CHECKSUM_RETRIES));
+
+    // Return the DMA to copy mode
+    eth_write_opcode(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_CSUMEN);
+
+    return (uint16_t)(eth_read_byte(EDMACSH) << 8) | eth_read_byte(EDMACSL);
+}
+
+/**
+ * @function:   eth_rx_checksum
+ * @param:      Offset from the start of the received frame.
+ * @param:      Number of bytes to be summed.
+ * @return:     Internet checksum of the frame range.
+ * @brief:      Calculates the checksum over a part of the frame
+ *              returned by the last eth_receive_packet call, or
+ *              by eth_rx_ring_get(WITH_ETH_RX_ISR).
+ */
+uint16_t
+eth_rx_checksum(uint16_t offset, uint16_t length)
+{
+#ifdef WITH_ETH_RX_ISR
+    return eth_ring_checksum(offset, length);
+#else
+    return eth_checksum(eth_rx_address(offset), length);
+#endif
+}
+
+/**
+ * @ISR:        ETH_INT_vect
+ * @brief:      Controller interrupt. Translates the controller
+ *              interrupt flags into ETH_EVENT_* flags. With flow
+ *              control enabled the receive buffer occupancy is
+ *              checked on every receive and overflow interrupt.
+ *
+ *              With WITH_ETH_RX_ISR the received frames are also
+ *              moved into the frame ring here, so frames do not
+ *              pile up in the controller while the main loop is
+ *              busy. The bank of the interrupted code is restored.
+ */
+ISR(ETH_INT_vect)
+{
+    struct clock_time_t stamp;
+    uint8_t bank = eth_bank_pointer;
+    bool drained;
+    uint8_t flags;
+
+    // Take the time first, before talking to the controller
+    clock_get_stamp(&stamp);
+
+    // Count the accesses below in their own classes, not in the
+    // operation that was interrupted
+    SPI_STATS_SUSPEND();
+
+    // Release the INT line until the main loop has handled the
+    // events, so every new batch of events produces a fresh edge.
+    eth_write_opcode(ENC28J60_BIT_FIELD_CLR, EIE, EIE_INTIE);
+
+    flags = eth_read_opcode(ENC28J60_READ_CTRL_REG, EIR);
+
+    // Arrival time of the packets announced
+    if(flags & EIR_PKTIF) {
+        eth_rx_stamp = stamp;
+        eth_rx_stamp_fresh = true;
+    }
+
+#ifdef WITH_ETH_RX_ISR
+    // PKTIF is not reliable(see Rev. B4 Silicon Errata point 6),
+    // look for frames on any event. Copying a full frame takes
+    // milliseconds, so the other interrupts(e.g. the clock tick)
+    // are allowed in meanwhile. The lock keeps this one masked.
+    eth_lock();
+    sei();
+
+    drained = eth_rx_drain();
+
+    cli();
+    eth_unlock();
+
+    if(eth_rx_ring_head != eth_rx_ring_tail) {
+        eth_events |= ETH_EVENT_RX;
+    }
+#else
+    // PKTIF is not reliable(see Rev. B4 Silicon Errata point 6),
+    // the receive path checks EPKTCNT on any event.
+    if(flags & EIR_PKTIF) {
+        eth_events |= ETH_EVENT_RX;
+    }
+
+    // The packets are left to the main loop
+    drained = !(flags & EIR_PKTIF);
+#endif
+
+    // Cleared by eth_ack_link_change
+    if(flags & EIR_LINKIF) {
+        eth_events |= ETH_EVENT_LINK;
+    }
+
+    if(flags & EIR_TXIF) {
+        eth_write_opcode(ENC28J60_BIT_FIELD_CLR, EIR, EIR_TXIF);
+        eth_events |= ETH_EVENT_TX;
+    }
+
+    // Cleared by eth_tx_periodic
+    if(flags & EIR_TXERIF) {
+        eth_events |= ETH_EVENT_TX;
+    }
+
+    // The receive buffer ran full and dropped one or more packets,
+    // the number of packets is not known.
+    if(flags & EIR_RXERIF) {
+        eth_write_opcode(ENC28J60_BIT_FIELD_CLR, EIR, EIR_RXERIF);
+        eth_stats.rx_overflow_events++;
+    }
+
+    // Watch the receive buffer here as well, the main loop may be
+    // stalled while the buffer fills up.
+    if(eth_flow_enabled && (flags & (EIR_PKTIF | EIR_RXERIF))) {
+        eth_flow_update(eth_get_rx_occupancy());
+    }
+
+    // Packets left in the controller keep PKTIF set, mask it until
+    // the main loop has room for them again. The line then stays
+    // armed, so an overflow(RXERIF) still reaches the flow control.
+    if(!drained) {
+        eth_write_opcode(ENC28J60_BIT_FIELD_CLR, EIE, EIE_PKTIE);
+    }
+
+    // Keep the line armed unless flags are left set for the main
+    // loop, which re-arms it once they have been handled.
+    if(!(flags & (EIR_LINKIF | EIR_TXERIF))) {
+        eth_write_opcode(ENC28J60_BIT_FIELD_SET, EIE, EIE_INTIE);
+    }
+
+    // Restore the bank of the interrupted code
+    eth_set_bank(bank);
+
+    SPI_STATS_RESUME();
 }
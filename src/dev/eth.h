@@ -25,15 +25,37 @@
  */
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
 #include "enc28j60.h"
 
+#include "lib/clock.h"
+
 #ifndef _ETH_H_
 #define _ETH_H_
 
+#if defined(SPI_TRANSPORT_USART)
+// Controller select settings
+#define ETH_SELECT_DDR  DDRB
+#define ETH_SELECT_PORT PORTB
+#define ETH_SELECT_PIN  PORTB4
+
+// Controller select settings
+#define ETH_RESET_DDR  DDRB
+#define ETH_RESET_PORT PORTB
+#define ETH_RESET_PIN  PORTB3
+
+// Controller interrupt line settings(INT2, INT0 is used by RXD1)
+#define ETH_INT_DDR  DDRB
+#define ETH_INT_PORT PORTB
+#define ETH_INT_PIN  PORTB2
+#else
 // Controller select settings
 #define ETH_SELECT_DDR  DDRB
 #define ETH_SELECT_PORT PORTB
@@ -44,14 +66,199 @@
 #define ETH_RESET_PORT PORTB
 #define ETH_RESET_PIN  PORTB3
 
-// Maximum frame lenght the driver will accept
-#define ETH_MAX_FRAME_LENGTH 1500
+// Controller interrupt line settings(INT0)
+#define ETH_INT_DDR  DDRD
+#define ETH_INT_PORT PORTD
+#define ETH_INT_PIN  PORTD2
+#endif
+
+// Controller event flags
+#define ETH_EVENT_RX   0x01
+#define ETH_EVENT_LINK 0x02
+#define ETH_EVENT_TX   0x04
+
+// Maximum frame length the driver will accept, counted the way the
+// controller counts it for MAMXFL: header, payload and CRC
+#define ETH_MAX_FRAME_LENGTH 1518
+
+// Maximum payload carried by a frame of ETH_MAX_FRAME_LENGTH bytes
+#define ETH_MAX_PAYLOAD_LENGTH (ETH_MAX_FRAME_LENGTH - 18)
+
+// SPI transactions(device selections) spent per frame, with bank 0
+// selected and not counting extra eth_read_packet calls:
+//   Receive:  2 ERDPT, 2 ERXWRPT(occupancy), 1 buffer read of the
+//             receive status vector and the headers, 2 ERXRDPT and
+//             1 PKTDEC. The packet counter(bank 1, 1 more to switch
+//             there and 1 back) is only read when the packets seen
+//             before are all released.
+//   Transmit: 2 EWRPT, 1 buffer write of the control byte and the
+//             frame, up to 2 ETXST, 1 or 2 ETXND and 1 TXRTS. The
+//             pointer bytes already holding the value are skipped.
+//             Collecting the completed frame reads ECON1 and clears
+//             EIR.TXERIF.
+// For small frames this fixed overhead costs more bus time than
+// the data itself.
+
+// Checksum attempts while the receive logic is busy
+#define ETH_CHECKSUM_RETRIES 4
+
+// Milliseconds between checks of EPKTCNT when no receive event
+// was raised(see Rev. B4 Silicon Errata point 6)
+#ifndef ETH_RX_POLL_INTERVAL
+#define ETH_RX_POLL_INTERVAL 10
+#endif
+
+// Polls of the clock ready flag after a reset, 100 us apart
+#define ETH_RESET_POLLS 1000
+
+// Retransmissions of a frame lost to a late collision(WITH_ETH_TX_STATUS)
+#ifndef ETH_TX_RETRIES
+#define ETH_TX_RETRIES 3
+#endif
+
+// Number of multicast groups that can be joined
+#ifndef ETH_MULTICAST_GROUPS
+#define ETH_MULTICAST_GROUPS 4
+#endif
+
+// Transmit buffer slots, each holding one frame(control byte,
+// frame and status vector) so a frame can be written while the
+// previous one is still being transmitted. The memory profile
+// selects how the 8 KB buffer is split between RX and TX:
+//   RX_HEAVY: 6.5 KB RX, 1 slot
+//   BALANCED: 5.0 KB RX, 2 slots
+//   TX_HEAVY: 3.5 KB RX, 3 slots
+#ifndef ETH_TX_SLOTS
+    #if defined(ETH_PROFILE_RX_HEAVY)
+        #define ETH_TX_SLOTS 1
+    #elif defined(ETH_PROFILE_TX_HEAVY)
+        #define ETH_TX_SLOTS 3
+    #else
+        #define ETH_TX_SLOTS 2
+    #endif
+#endif
+
+#define ETH_TX_SLOT_SIZE 0x0600
+
+// Controller memory handed out as application buffers(dev/xmem),
+// taken from the end of the receive buffer.
+#ifndef ETH_XMEM_SIZE
+#define ETH_XMEM_SIZE 0x0000
+#endif
 
 // Ethernet RX/TX buffer memory map
-#define ETH_REG_RX_START (0x0000)
-#define ETH_REG_RX_STOP  (0x1FFF - 0x0600 - 1)
-#define ETH_REG_TX_START (0x1FFF - 0x0600)
-#define ETH_REG_TX_STOP  (0x1FFF)
+#define ETH_REG_RX_START   (0x0000)
+#define ETH_REG_RX_STOP    (ETH_REG_XMEM_START - 1)
+#define ETH_REG_XMEM_START (ETH_REG_TX_START - ETH_XMEM_SIZE)
+#define ETH_REG_XMEM_STOP  (ETH_REG_TX_START - 1)
+#define ETH_REG_TX_START   (0x2000 - (ETH_TX_SLOTS * ETH_TX_SLOT_SIZE))
+#define ETH_REG_TX_STOP    (0x1FFF)
+
+// Size of the receive buffer
+#define ETH_RX_BUFFER_SIZE (ETH_REG_RX_STOP - ETH_REG_RX_START + 1)
+
+// The receive buffer has to end on an odd address(see silicon
+// errata) and hold at least two full frames.
+#if (ETH_XMEM_SIZE & 1)
+    #error *** ETH_XMEM_SIZE must be even ***
+#endif
+
+#if (ETH_RX_BUFFER_SIZE < (2 * ETH_TX_SLOT_SIZE))
+    #error *** ETH_XMEM_SIZE leaves too little receive buffer ***
+#endif
+
+// Receive buffer fill levels at which flow control pauses
+// and resumes the link partner
+#ifndef ETH_FLOW_HIGH_WATER
+#define ETH_FLOW_HIGH_WATER ((ETH_RX_BUFFER_SIZE / 4) * 3)
+#endif
+
+#ifndef ETH_FLOW_LOW_WATER
+#define ETH_FLOW_LOW_WATER  (ETH_RX_BUFFER_SIZE / 4)
+#endif
+
+// Frame ring filled by the controller interrupt(WITH_ETH_RX_ISR),
+// each slot holds a whole frame plus a string delimiter. Frames
+// not fitting a slot are dropped and counted as truncated.
+#ifndef ETH_RX_RING_SLOTS
+#define ETH_RX_RING_SLOTS 2
+#endif
+
+#ifndef ETH_RX_RING_FRAME_SIZE
+#define ETH_RX_RING_FRAME_SIZE 500
+#endif
+
+#if (ETH_RX_RING_SLOTS & (ETH_RX_RING_SLOTS - 1))
+    #error *** ETH_RX_RING_SLOTS must be a power of two ***
+#endif
+
+/**
+ * @struct:     eth_filter_field_t
+ * @brief:      Range of bytes a packet has to match to pass the
+ *              pattern match filter.
+ */
+struct eth_filter_field_t {
+    uint8_t offset;             //< Offset from the start of the packet
+    uint8_t length;             //< Number of bytes to be matched
+    const uint8_t* data;        //< Bytes to be matched
+};
+
+/**
+ * @struct:     eth_reg_write_t
+ * @brief:      Control register write for eth_write_batch.
+ */
+struct eth_reg_write_t {
+    uint8_t address;            //< Register address
+    uint8_t data;               //< Byte to be written
+};
+
+// Fragment flags
+#define ETH_FRAGMENT_PGM 0x01   //< Data located in program memory
+
+/**
+ * @struct:     eth_fragment_t
+ * @brief:      Part of a packet sent by eth_send_fragments.
+ */
+struct eth_fragment_t {
+    const uint8_t* data;        //< First byte of the fragment
+    uint16_t length;            //< Number of bytes
+    uint8_t flags;              //< ETH_FRAGMENT_* flags
+};
+
+/**
+ * @struct:     eth_checksum_t
+ * @brief:      Checksum filled in by the controller DMA checksum
+ *              engine once a frame is in its transmit slot: the
+ *              sum over the frame from start to its end, plus a
+ *              partial sum(e.g. the pseudo header) is written at
+ *              field. The field must be zero in the frame.
+ */
+struct eth_checksum_t {
+    uint16_t start;             //< Frame offset of the first byte summed
+    uint16_t field;             //< Frame offset of the checksum field
+    uint16_t sum;               //< Partial sum added, not complemented
+};
+
+/**
+ * @struct:     eth_stats_t
+ * @brief:      Receive error and transmit statistics of the controller.
+ *              The transmit counters are only collected when built
+ *              with WITH_ETH_TX_STATUS.
+ */
+struct eth_stats_t {
+    uint32_t rx_overflow_events; //< Receive buffer overflows(RXERIF), not dropped packets
+    uint32_t rx_crc_errors;     //< Packets received with a CRC error
+    uint32_t rx_truncated;      //< Packets not fully read by the host
+    uint32_t rx_pauses;         //< Times flow control paused the link partner
+    uint16_t rx_resets;         //< Receive logic resets after corruption
+    uint16_t rx_high_water;     //< Highest receive buffer occupancy(bytes)
+
+    uint32_t tx_collisions;     //< Collisions seen while sending
+    uint32_t tx_late_collisions; //< Packets hit by a late collision
+    uint32_t tx_deferrals;      //< Packets deferred for a busy medium
+    uint32_t tx_aborts;         //< Packets given up by the controller
+    uint32_t tx_retries;        //< Packets sent again after a late collision
+};
 
 /**
  * @function:   eth_enable
@@ -79,6 +286,22 @@ extern void eth_select(void);
  */
 extern void eth_deselect(void);
 
+/**
+ * @function:   eth_lock
+ * @brief:      Holds off the controller interrupt until the matching
+ *              eth_unlock call, so a sequence of transactions is not
+ *              interleaved with those of the interrupt routine.
+ *              Calls may be nested.
+ */
+extern void eth_lock(void);
+
+/**
+ * @function:   eth_unlock
+ * @brief:      Releases the controller interrupt held off by the
+ *              matching eth_lock call.
+ */
+extern void eth_unlock(void);
+
 /**
  * @function:   eth_init
  * @param:      mac_address, hardware mac address.
@@ -96,7 +319,8 @@ extern void eth_set_mac(uint8_t* mac_address);
 /**
  * @function:   eth_set_bank
  * @param:      address, bank address to be set
- * @brief:      Sets the bank pointer
+ * @brief:      Sets the bank pointer, only changing the bank
+ *              select bits that differ.
  */
 extern void eth_set_bank(uint8_t address);
 
@@ -119,7 +343,9 @@ extern void eth_set_clock(uint8_t value);
  * @function:   eth_get_rx_packet_count
  * @return:     Amount of pending packets in the controller.
  * @brief:      Returns the amound of unprocessed packets stored
- *              in the ethernet controller.
+ *              in the ethernet controller. The counter is only read
+ *              again once the packets seen last time are released,
+ *              later arrivals show up from then on.
  */
 extern uint8_t eth_get_rx_packet_count(void);
 
@@ -130,6 +356,30 @@ extern uint8_t eth_get_rx_packet_count(void);
  */
 extern uint8_t eth_get_link_status(void);
 
+/**
+ * @function:   eth_ack_link_change
+ * @return:     The current status value of the ethernet link.
+ * @brief:      Acknowledges a link change(ETH_EVENT_LINK) and
+ *              returns the new status of the ethernet link.
+ */
+extern uint8_t eth_ack_link_change(void);
+
+/**
+ * @function:   eth_is_full_duplex
+ * @return:     True when operating in full duplex mode.
+ * @brief:      Returns the duplex mode the MAC is configured for.
+ */
+extern bool eth_is_full_duplex(void);
+
+/**
+ * @function:   eth_get_rx_occupancy
+ * @return:     Number of bytes in use in the receive buffer.
+ * @brief:      Samples the receive buffer fill level, the distance
+ *              between the hardware write pointer(ERXWRPT) and the
+ *              oldest packet held(ERXRDPT). At most ETH_RX_BUFFER_SIZE.
+ */
+extern uint16_t eth_get_rx_occupancy(void);
+
 /**
  * @function:   eth_get_link_status
  * @return:     Core revision number.
@@ -137,6 +387,80 @@ extern uint8_t eth_get_link_status(void);
  */
 extern uint8_t eth_get_revision(void);
 
+/**
+ * @function:   eth_set_pattern_filter
+ * @param:      Fields the packets have to match.
+ * @param:      Number of fields, zero disables the filter.
+ * @return:     True when the filter has been set, false when the
+ *              fields do not fit the 64 byte match window.
+ * @brief:      Programs the pattern match filter, passing packets
+ *              that match all given fields. This replaces the
+ *              current pattern, only one can be active.
+ */
+extern bool eth_set_pattern_filter(const struct eth_filter_field_t* fields, uint8_t count);
+
+/**
+ * @function:   eth_join_multicast
+ * @param:      Multicast mac address to be received.
+ * @return:     True when the group has been joined.
+ * @brief:      Adds a multicast address to the hash table filter
+ *              so packets sent to the group reach the host.
+ */
+extern bool eth_join_multicast(const uint8_t* mac_address);
+
+/**
+ * @function:   eth_leave_multicast
+ * @param:      Multicast mac address no longer to be received.
+ * @return:     True when the group has been left.
+ * @brief:      Removes a multicast address from the hash table filter.
+ */
+extern bool eth_leave_multicast(const uint8_t* mac_address);
+
+/**
+ * @function:   eth_is_multicast_member
+ * @param:      Multicast mac address.
+ * @return:     True when the group has been joined.
+ * @brief:      The hash table filter also passes groups sharing a
+ *              hash bit with a joined group, use this to drop them.
+ */
+extern bool eth_is_multicast_member(const uint8_t* mac_address);
+
+/**
+ * @function:   eth_set_flow_control
+ * @param:      True to enable flow control.
+ * @brief:      Pauses the link partner while the receive buffer is
+ *              filled above ETH_FLOW_HIGH_WATER, until it drops below
+ *              ETH_FLOW_LOW_WATER. Pause frames are used in full
+ *              duplex mode, backpressure in half duplex mode.
+ */
+extern void eth_set_flow_control(bool enable);
+
+/**
+ * @function:   eth_get_stats
+ * @param:      Structure the statistics are copied to.
+ * @brief:      Returns a snapshot of the controller statistics.
+ */
+extern void eth_get_stats(struct eth_stats_t* stats);
+
+/**
+ * @function:   eth_get_events
+ * @return:     Mask of ETH_EVENT_* flags.
+ * @brief:      Returns and clears the events gathered by the
+ *              controller interrupt since the last call. When
+ *              no events are pending the controller does not
+ *              need to be accessed at all.
+ */
+extern uint8_t eth_get_events(void);
+
+/**
+ * @function:   eth_enable_interrupt
+ * @brief:      Re-arms the controller interrupt line and the
+ *              receive interrupt after the pending events have
+ *              been handled. Events that are still pending will
+ *              trigger a new interrupt.
+ */
+extern void eth_enable_interrupt(void);
+
 /**
  * @function:   eth_read_byte
  * @param:      Register address to be read.
@@ -153,6 +477,27 @@ extern uint8_t eth_read_byte(uint8_t address);
  */
 extern void eth_write_byte(uint8_t address, uint8_t data);
 
+/**
+ * @function:   eth_write_batch
+ * @param:      List of register writes.
+ * @param:      Number of writes in the list.
+ * @brief:      Writes a list of control registers grouped by bank,
+ *              starting with the bank already selected, so every
+ *              bank is switched to at most once. Writes to the same
+ *              bank keep their order, writes to the registers common
+ *              to all banks(EIE to ECON1) go first.
+ */
+extern void eth_write_batch(const struct eth_reg_write_t* writes, uint8_t count);
+
+/**
+ * @function:   eth_write_batch_P
+ * @param:      List of register writes in program memory.
+ * @param:      Number of writes in the list.
+ * @brief:      Same as eth_write_batch, for a list of writes kept
+ *              in program memory.
+ */
+extern void eth_write_batch_P(const struct eth_reg_write_t* writes, uint8_t count);
+
 /**
  * @function:   eth_read_phy_h
  * @param:      PHY register address to be read.
@@ -213,16 +558,173 @@ extern void eth_write_buffer(uint16_t length, uint8_t* data);
  * @param:      Lenght of the packet to be send.
  * @param:      Local packet buffer to be read from.
  * @brief:      Sends an ethernet packet to the ethernet controller.
+ *              The packet is queued in a free transmit slot, this
+ *              only blocks when all slots are still in flight.
  */
 extern void eth_send_packet(uint16_t length, uint8_t* packet);
 
+/**
+ * @function:   eth_send_reply
+ * @param:      Lenght of the reply to be send.
+ * @param:      Lenght of the reply header.
+ * @param:      Local buffer holding the reply header.
+ * @param:      Checksum to be calculated over the reply once it
+ *              is in the transmit slot, or NULL.
+ * @brief:      Sends a reply built from the packet returned by the
+ *              last eth_peek_packet call. Only the header is written
+ *              over SPI, the rest of the reply is copied from the
+ *              received packet by the controller DMA. When frames
+ *              are received from the ring(WITH_ETH_RX_ISR) the
+ *              header and the rest of the ring slot are gathered
+ *              into the transmit slot.
+ */
+extern void eth_send_reply(uint16_t length, uint16_t header_length, uint8_t* header, const struct eth_checksum_t* checksum);
+
+/**
+ * @function:   eth_send_fragments
+ * @param:      List of fragments making up the packet.
+ * @param:      Number of fragments in the list.
+ * @brief:      Sends a packet gathered from several buffers, e.g. a
+ *              header template in program memory, the payload and a
+ *              trailer. The fragments are streamed into the transmit
+ *              slot in order, so the packet never has to be assembled
+ *              in RAM. The buffers may be reused when this returns.
+ */
+extern void eth_send_fragments(const struct eth_fragment_t* fragments, uint8_t count);
+
+/**
+ * @function:   eth_send_memory
+ * @param:      Controller memory address of the packet.
+ * @param:      Lenght of the packet to be send.
+ * @brief:      Sends a packet held in controller memory outside
+ *              the receive buffer, e.g. an xmem buffer. The packet
+ *              is copied into a transmit slot by the controller DMA.
+ */
+extern void eth_send_memory(uint16_t address, uint16_t length);
+
+/**
+ * @function:   eth_dma_copy
+ * @param:      Controller memory address of the destination.
+ * @param:      Controller memory address of the first byte.
+ * @param:      Controller memory address of the last byte.
+ * @brief:      Copies a range of controller memory using the DMA
+ *              and waits until it completes. A range ending before
+ *              it starts wraps around the end of the receive buffer.
+ */
+extern void eth_dma_copy(uint16_t destination, uint16_t start, uint16_t end);
+
+/**
+ * @function:   eth_tx_periodic
+ * @brief:      Frees the transmit slot of a completed frame and
+ *              starts the next queued one. Call this on every
+ *              ETH_EVENT_TX event.
+ */
+extern void eth_tx_periodic(void);
+
 /**
  * @function:   eth_receive_packet
  * @param:      Maximum lenght of the packet to be read.
  * @param:      Local packet buffer to be written to.
  * @brief:      Reads a pending ethernet packet from the ethernet controller.
+ *              The packet must be freed using eth_release_packet.
  */
 extern uint16_t eth_receive_packet(uint16_t max_length, uint8_t* packet);
 
+/**
+ * @function:   eth_peek_packet
+ * @param:      Number of bytes to be read from the packet start.
+ * @param:      Local packet buffer to be written to, should hold
+ *              one more byte than requested.
+ * @return:     Full length of the packet, zero when invalid.
+ * @brief:      Reads only the first part of a pending ethernet packet,
+ *              the rest can be read on demand using eth_read_packet.
+ *              The packet must be freed using eth_release_packet.
+ */
+extern uint16_t eth_peek_packet(uint16_t peek_length, uint8_t* packet);
+
+/**
+ * @function:   eth_read_packet
+ * @param:      Offset from the start of the received packet.
+ * @param:      Lenght of data to be read.
+ * @param:      Local data buffer to be written to.
+ * @brief:      Reads a part of the packet returned by the last
+ *              eth_peek_packet or eth_receive_packet call.
+ */
+extern void eth_read_packet(uint16_t offset, uint16_t length, uint8_t* data);
+
+/**
+ * @function:   eth_get_rx_stamp
+ * @param:      Time point to be filled in.
+ * @brief:      Returns the arrival time of the packet returned by
+ *              the last eth_peek_packet, eth_receive_packet or
+ *              eth_rx_ring_get call: the moment the controller
+ *              interrupt announced it. Packets that were not
+ *              announced by an interrupt of their own, e.g. the
+ *              rest of a burst, carry the time they were read
+ *              from the controller instead.
+ */
+extern void eth_get_rx_stamp(struct clock_time_t* stamp);
+
+/**
+ * @function:   eth_release_packet
+ * @brief:      Frees the memory of the packet last read by
+ *              eth_receive_packet. Until then the frame is kept
+ *              in the controller for eth_rx_checksum.
+ */
+extern void eth_release_packet(void);
+
+#ifdef WITH_ETH_RX_ISR
+/**
+ * @function:   eth_rx_ring_get
+ * @param:      Set to the ring slot holding the frame.
+ * @return:     Length of the oldest frame in the ring, zero when empty.
+ * @brief:      Returns the oldest frame received by the interrupt
+ *              routine. The slot may be modified in place and is
+ *              owned by the caller until eth_rx_ring_release.
+ */
+extern uint16_t eth_rx_ring_get(uint8_t** packet);
+
+/**
+ * @function:   eth_rx_ring_release
+ * @brief:      Hands the slot of the frame returned by the last
+ *              eth_rx_ring_get call back to the interrupt routine.
+ */
+extern void eth_rx_ring_release(void);
+#endif
+
+/**
+ * @function:   eth_rx_poll
+ * @return:     True when frames are waiting in the controller.
+ * @brief:      Fallback for a lost receive interrupt(see Rev. B4
+ *              Silicon Errata point 6). Looks at EPKTCNT at most
+ *              once per ETH_RX_POLL_INTERVAL ms, call it when no
+ *              ETH_EVENT_RX was raised. With WITH_ETH_RX_ISR the
+ *              frames found are moved into the frame ring.
+ */
+extern bool eth_rx_poll(void);
+
+/**
+ * @function:   eth_checksum
+ * @param:      Controller memory address of the first byte.
+ * @param:      Number of bytes to be summed.
+ * @return:     Internet checksum of the memory range.
+ * @brief:      Calculates the one's complement checksum over
+ *              controller memory using the DMA checksum engine.
+ *              Ranges running past the end of the receive buffer
+ *              wrap around to its start.
+ */
+extern uint16_t eth_checksum(uint16_t address, uint16_t length);
+
+/**
+ * @function:   eth_rx_checksum
+ * @param:      Offset from the start of the received frame.
+ * @param:      Number of bytes to be summed.
+ * @return:     Internet checksum of the frame range.
+ * @brief:      Calculates the checksum over a part of the frame
+ *              returned by the last eth_receive_packet call, or
+ *              by eth_rx_ring_get(WITH_ETH_RX_ISR).
+ */
+extern uint16_t eth_rx_checksum(uint16_t offset, uint16_t length);
+
 /* !_ETH_H_ */
 #endif
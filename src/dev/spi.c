@@ -25,6 +25,75 @@
 
 #include "spi.h"
 
+// The USART has a double buffered transmitter, so bytes can be
+// sent back-to-back without an idle gap between them.
+#if defined(SPI_TRANSPORT_USART)
+    #if !defined(__AVR_ATmega644P__) && !defined(__AVR_ATmega644PA__) && \
+        !defined(__AVR_ATmega1284__) && !defined(__AVR_ATmega1284P__)
+        #error *** Check USART SPI settings in spi.c ***
+    #endif
+#endif
+
+// Rate bits for the SPI_CLOCK_DIVIDER
+#if defined(SPI_TRANSPORT_USART)
+    #if (SPI_CLOCK_DIVIDER < 2) || (SPI_CLOCK_DIVIDER % 2)
+        #error *** Check SPI_CLOCK_DIVIDER, the USART takes even dividers only ***
+    #endif
+#elif SPI_CLOCK_DIVIDER == 2
+    #define SPI_SPCR_RATE 0
+    #define SPI_SPSR_RATE (1 << SPI2X)
+#elif SPI_CLOCK_DIVIDER == 4
+    #define SPI_SPCR_RATE 0
+    #define SPI_SPSR_RATE 0
+#elif SPI_CLOCK_DIVIDER == 8
+    #define SPI_SPCR_RATE (1 << SPR0)
+    #define SPI_SPSR_RATE (1 << SPI2X)
+#elif SPI_CLOCK_DIVIDER == 16
+    #define SPI_SPCR_RATE (1 << SPR0)
+    #define SPI_SPSR_RATE 0
+#elif SPI_CLOCK_DIVIDER == 32
+    #define SPI_SPCR_RATE (1 << SPR1)
+    #define SPI_SPSR_RATE (1 << SPI2X)
+#elif SPI_CLOCK_DIVIDER == 64
+    #define SPI_SPCR_RATE (1 << SPR1)
+    #define SPI_SPSR_RATE 0
+#elif SPI_CLOCK_DIVIDER == 128
+    #define SPI_SPCR_RATE ((1 << SPR1) | (1 << SPR0))
+    #define SPI_SPSR_RATE 0
+#else
+    #error *** Check SPI_CLOCK_DIVIDER, the SPI takes 2, 4, 8, 16, 32, 64 or 128 ***
+#endif
+
+#ifdef WITH_SPI_STATS
+// Timer1 interrupt registers
+#if defined(__AVR_ATmega32__)
+    #define SPI_STATS_TIMSK TIMSK
+    #define SPI_STATS_TIFR  TIFR
+#elif defined(__AVR_ATmega644P__) || defined(__AVR_ATmega644PA__) || \
+      defined(__AVR_ATmega1284__) || defined(__AVR_ATmega1284P__)
+    #define SPI_STATS_TIMSK TIMSK1
+    #define SPI_STATS_TIFR  TIFR1
+#else
+    #error *** Check Timer1 settings in spi.c ***
+#endif
+
+// Statistics per operation class
+static struct spi_stats_t spi_stats[SPI_STATS_CLASSES];
+
+// Timer1 overflows, the upper half of the cycle counter
+static volatile uint16_t spi_stats_overflows;
+
+// Class, nesting depth and start time of the running operation
+static uint8_t  spi_stats_class;
+static uint8_t  spi_stats_depth;
+static uint32_t spi_stats_start;
+
+// Operation set aside by spi_stats_suspend
+static uint8_t  spi_stats_saved_class;
+static uint8_t  spi_stats_saved_depth;
+static uint32_t spi_stats_saved_at;
+#endif
+
 /**
  * @function:   spi_init
  * @brief:      Used to initialise SPI interface as master
@@ -32,6 +101,33 @@
 void
 spi_init(void)
 {
+#ifdef WITH_SPI_STATS
+    // Timer1 free running at the CPU clock counts the cycles,
+    // its overflows extend the count to 32 bits.
+    TCCR1A = 0;
+    TCCR1B = (1 << CS10);
+    SPI_STATS_TIMSK |= (1 << TOIE1);
+#endif
+
+#if defined(SPI_TRANSPORT_USART)
+    // Already initialized?
+    if(UCSR1B & (1 << TXEN1)) {
+        return;
+    }
+
+    // USART1 port mapping
+    DDRD |= (1 << DDD3);	// MOSI(TXD1)
+    DDRD &= ~(1 << DDD2);	// MISO(RXD1)
+    DDRD |= (1 << DDD4);	// SCK(XCK1)
+
+    // Master SPI mode 0, MSB first. The baud rate has to be zero
+    // while the transmitter is enabled, then F_CPU/SPI_CLOCK_DIVIDER
+    // is selected.
+    UBRR1  = 0;
+    UCSR1C = (1 << UMSEL11) | (1 << UMSEL10);
+    UCSR1B = (1 << RXEN1) | (1 << TXEN1);
+    UBRR1  = (SPI_CLOCK_DIVIDER / 2) - 1;
+#else
     // Already initialized?
     if(SPCR & (1 << SPE)) {
         return;
@@ -44,7 +140,9 @@ spi_init(void)
         DDRB |= (1 << DDB1);	// SCK
     #elif defined(__AVR_ATmega16__) || defined (__AVR_ATmega164__) || defined (__AVR_ATmega164A__) || \
           defined(__AVR_ATmega32__) || defined (__AVR_ATmega324__) || defined (__AVR_ATmega324A__) || \
-          defined(__AVR_ATmega64__) || defined (__AVR_ATmega644__) || defined (__AVR_ATmega644A__)
+          defined(__AVR_ATmega64__) || defined (__AVR_ATmega644__) || defined (__AVR_ATmega644A__) || \
+          defined(__AVR_ATmega644P__) || defined (__AVR_ATmega644PA__) || \
+          defined(__AVR_ATmega1284__) || defined (__AVR_ATmega1284P__)
         DDRB |= (1 << DDB5);	// MOSI
         DDRB &= ~(1 << DDB6);	// MISO
         DDRB |= (1 << DDB7);	// SCK
@@ -57,8 +155,9 @@ spi_init(void)
     #endif
 
     // Configure the SPI interface as master
-    SPCR  = (1 << SPE) | (1 << MSTR);
-    SPSR |= (1 << SPI2X);
+    SPCR  = (1 << SPE) | (1 << MSTR) | SPI_SPCR_RATE;
+    SPSR |= SPI_SPSR_RATE;
+#endif
 }
 
 /**
@@ -71,6 +170,177 @@ spi_wait(void)
     // XXX: Not implemented
 }
 
+#ifdef WITH_SPI_STATS
+/**
+ * @ISR:        TIMER1_OVF_vect
+ * @brief:      Counts the Timer1 overflows of the cycle counter.
+ */
+ISR(TIMER1_OVF_vect)
+{
+    spi_stats_overflows++;
+}
+
+/**
+ * @function:   spi_stats_cycles
+ * @return:     CPU cycles counted by Timer1 and its overflows.
+ * @brief:      Reads the 32 bit cycle counter, must be called
+ *              with interrupts disabled.
+ */
+static uint32_t
+spi_stats_cycles(void)
+{
+    uint16_t overflows = spi_stats_overflows;
+    uint16_t count = TCNT1;
+
+    // The counter wrapped but the overflow has not been handled yet
+    if((SPI_STATS_TIFR & (1 << TOV1)) && (count < 0x8000)) {
+        overflows++;
+    }
+
+    return ((uint32_t) overflows << 16) | count;
+}
+
+/**
+ * @function:   spi_stats_begin
+ * @param:      Operation class(SPI_STATS_*).
+ * @brief:      Starts an operation of the given class. Operations
+ *              may be nested, everything up to the matching
+ *              spi_stats_end call of the outermost operation is
+ *              counted in its class. Interrupt routines talking
+ *              to the device bracket their work with
+ *              spi_stats_suspend and spi_stats_resume.
+ */
+void
+spi_stats_begin(uint8_t class)
+{
+    uint8_t sreg = SREG;
+
+    // Timer1 is read as two bytes, an interrupt in between would
+    // corrupt the high byte.
+    cli();
+
+    if(spi_stats_depth++ == 0) {
+        spi_stats_class = class;
+        spi_stats_start = spi_stats_cycles();
+    }
+
+    SREG = sreg;
+}
+
+/**
+ * @function:   spi_stats_count
+ * @param:      Number of bytes transferred.
+ * @brief:      Counts a transaction in the running operation.
+ */
+void
+spi_stats_count(uint16_t bytes)
+{
+    uint8_t sreg = SREG;
+
+    cli();
+
+    spi_stats[spi_stats_class].transactions++;
+    spi_stats[spi_stats_class].bytes += bytes;
+
+    SREG = sreg;
+}
+
+/**
+ * @function:   spi_stats_end
+ * @brief:      Ends an operation started by spi_stats_begin.
+ */
+void
+spi_stats_end(void)
+{
+    uint8_t sreg = SREG;
+
+    cli();
+
+    if(--spi_stats_depth == 0) {
+        spi_stats[spi_stats_class].cycles += spi_stats_cycles() - spi_stats_start;
+    }
+
+    SREG = sreg;
+}
+
+/**
+ * @function:   spi_stats_suspend
+ * @brief:      Sets the running operation aside on entry of an
+ *              interrupt routine, so its accesses are counted in
+ *              their own classes. Interrupt routines calling this
+ *              must not nest.
+ */
+void
+spi_stats_suspend(void)
+{
+    uint8_t sreg = SREG;
+
+    cli();
+
+    spi_stats_saved_class = spi_stats_class;
+    spi_stats_saved_depth = spi_stats_depth;
+    spi_stats_saved_at = spi_stats_cycles();
+
+    spi_stats_depth = 0;
+
+    SREG = sreg;
+}
+
+/**
+ * @function:   spi_stats_resume
+ * @brief:      Continues the operation set aside by spi_stats_suspend,
+ *              the time spent in between is not counted in it.
+ */
+void
+spi_stats_resume(void)
+{
+    uint8_t sreg = SREG;
+
+    cli();
+
+    spi_stats_class = spi_stats_saved_class;
+    spi_stats_depth = spi_stats_saved_depth;
+    spi_stats_start += spi_stats_cycles() - spi_stats_saved_at;
+
+    SREG = sreg;
+}
+
+/**
+ * @function:   spi_get_stats
+ * @param:      Operation class(SPI_STATS_*).
+ * @param:      Statistics to be filled in.
+ * @brief:      Returns the bus work counted for an operation class
+ *              since startup or the last spi_reset_stats call.
+ */
+void
+spi_get_stats(uint8_t class, struct spi_stats_t* stats)
+{
+    uint8_t sreg = SREG;
+
+    cli();
+
+    *stats = spi_stats[class];
+
+    SREG = sreg;
+}
+
+/**
+ * @function:   spi_reset_stats
+ * @brief:      Clears the statistics of all operation classes.
+ */
+void
+spi_reset_stats(void)
+{
+    uint8_t sreg = SREG;
+
+    cli();
+
+    memset(spi_stats, 0, sizeof(spi_stats));
+
+    SREG = sreg;
+}
+#endif
+
 /**
  * @function:   spi_write_byte
  * @brief:      Writes a byte over the SPI interface
@@ -78,9 +348,17 @@ spi_wait(void)
 void
 spi_write_byte(uint8_t data)
 {
+#if defined(SPI_TRANSPORT_USART)
+    UDR1 = data;
+
+    // Discard the byte received meanwhile
+    while(!(UCSR1A & (1 << RXC1)));
+    (void) UDR1;
+#else
     SPDR = data;
 
     while(!(SPSR & (1 << SPIF)));
+#endif
 }
 
 /**
@@ -90,9 +368,15 @@ spi_write_byte(uint8_t data)
 uint8_t
 spi_read_byte(void)
 {
+#if defined(SPI_TRANSPORT_USART)
+    UDR1 = 0x00;
+    while(!(UCSR1A & (1 << RXC1)));
+    return UDR1;
+#else
     SPDR = 0x00;
     while(!(SPSR & (1 << SPIF)));
     return SPDR;
+#endif
 }
 
 /**
@@ -120,3 +404,157 @@ spi_read_word(void)
 
     return result;
 }
+
+#if defined(SPI_TRANSPORT_USART)
+/**
+ * @function:   spi_write_block
+ * @param:      Lenght of data to be written.
+ * @param:      Local data buffer to be read from.
+ * @brief:      Writes a block of data over the SPI interface
+ *              back-to-back. The transmit buffer is refilled
+ *              while the current byte is shifted out, so there
+ *              is no gap between the bytes.
+ */
+void
+spi_write_block(uint16_t length, const uint8_t* data)
+{
+    if(length == 0) {
+        return;
+    }
+
+    // Clear the transmit complete flag
+    UCSR1A = (1 << TXC1);
+
+    while(length--) {
+        while(!(UCSR1A & (1 << UDRE1)));
+
+        UDR1 = *data++;
+
+        // Keep the receiver from overflowing
+        if(UCSR1A & (1 << RXC1)) {
+            (void) UDR1;
+        }
+    }
+
+    // Wait for the last byte to leave and drop what was received
+    while(!(UCSR1A & (1 << TXC1)));
+
+    while(UCSR1A & (1 << RXC1)) {
+        (void) UDR1;
+    }
+}
+
+/**
+ * @function:   spi_read_block
+ * @param:      Lenght of data to be read.
+ * @param:      Local data buffer to be written to.
+ * @brief:      Reads a block of data from the SPI interface
+ *              back-to-back. Two transfers are kept in flight,
+ *              one shifting and one waiting in the transmit
+ *              buffer.
+ */
+void
+spi_read_block(uint16_t length, uint8_t* data)
+{
+    uint16_t pending = length;
+
+    if(length == 0) {
+        return;
+    }
+
+    // Fill the shift register and the transmit buffer
+    UDR1 = 0x00;
+    pending--;
+
+    if(pending) {
+        UDR1 = 0x00;
+        pending--;
+    }
+
+    while(length--) {
+        while(!(UCSR1A & (1 << RXC1)));
+
+        *data++ = UDR1;
+
+        // A byte was received, so the transmit buffer has room
+        if(pending) {
+            UDR1 = 0x00;
+            pending--;
+        }
+    }
+}
+#else
+/**
+ * @function:   spi_write_block
+ * @param:      Lenght of data to be written.
+ * @param:      Local data buffer to be read from.
+ * @brief:      Writes a block of data over the SPI interface
+ *              back-to-back. The next byte is fetched from
+ *              memory while the current one is shifted out.
+ */
+void
+spi_write_block(uint16_t length, const uint8_t* data)
+{
+    uint8_t next;
+
+    if(length == 0) {
+        return;
+    }
+
+    // Start shifting out the first byte
+    SPDR = *data++;
+
+    while(--length) {
+        // Fetch the next byte while the current one is on the wire
+        next = *data++;
+
+        while(!(SPSR & (1 << SPIF)));
+
+        // Reload the data register as soon as it becomes free
+        SPDR = next;
+    }
+
+    // Wait for the last byte to leave
+    while(!(SPSR & (1 << SPIF)));
+}
+
+/**
+ * @function:   spi_read_block
+ * @param:      Lenght of data to be read.
+ * @param:      Local data buffer to be written to.
+ * @brief:      Reads a block of data from the SPI interface
+ *              back-to-back. The next transfer is started
+ *              before the received byte is stored to memory.
+ */
+void
+spi_read_block(uint16_t length, uint8_t* data)
+{
+    uint8_t current;
+
+    if(length == 0) {
+        return;
+    }
+
+    // Start shifting in the first byte
+    SPDR = 0x00;
+
+    while(--length) {
+        while(!(SPSR & (1 << SPIF)));
+
+        // Pick up the received byte and immediately start the next
+        // transfer, the store below then overlaps with the shifting.
+        current = SPDR;
+        SPDR = 0x00;
+
+        // Keep the compiler from hoisting the store above the reload
+        __asm__ __volatile__("" ::: "memory");
+
+        *data++ = current;
+    }
+
+    // Collect the last byte
+    while(!(SPSR & (1 << SPIF)));
+
+    *data = SPDR;
+}
+#endif
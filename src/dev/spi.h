@@ -24,11 +24,62 @@
  */
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
 #include <avr/io.h>
+#include <avr/interrupt.h>
 
 #ifndef _SPI_H_
 #define _SPI_H_
 
+// Name of the SPI transport in use
+#if defined(SPI_TRANSPORT_USART)
+    #define SPI_TRANSPORT_NAME "USART1"
+#else
+    #define SPI_TRANSPORT_NAME "SPI"
+#endif
+
+// SPI clock as a division of F_CPU: 2, 4, 8, 16, 32, 64 or 128.
+// The USART transport takes any even divider.
+#ifndef SPI_CLOCK_DIVIDER
+#define SPI_CLOCK_DIVIDER 2
+#endif
+
+// Controller operation classes of the statistics(WITH_SPI_STATS)
+#define SPI_STATS_REG_READ  0   //< Control register reads
+#define SPI_STATS_REG_WRITE 1   //< Control register writes and bit field operations
+#define SPI_STATS_BANK      2   //< Register bank switches
+#define SPI_STATS_PHY       3   //< PHY register accesses
+#define SPI_STATS_BUF_READ  4   //< Buffer memory reads
+#define SPI_STATS_BUF_WRITE 5   //< Buffer memory writes
+#define SPI_STATS_CLASSES   6
+
+// Statistics hooks, empty unless built with WITH_SPI_STATS
+#ifdef WITH_SPI_STATS
+    #define SPI_STATS_BEGIN(class) spi_stats_begin(class)
+    #define SPI_STATS_COUNT(bytes) spi_stats_count(bytes)
+    #define SPI_STATS_END()        spi_stats_end()
+    #define SPI_STATS_SUSPEND()    spi_stats_suspend()
+    #define SPI_STATS_RESUME()     spi_stats_resume()
+#else
+    #define SPI_STATS_BEGIN(class)
+    #define SPI_STATS_COUNT(bytes)
+    #define SPI_STATS_END()
+    #define SPI_STATS_SUSPEND()
+    #define SPI_STATS_RESUME()
+#endif
+
+/**
+ * @struct:     spi_stats_t
+ * @brief:      Bus work spent on one class of controller operations.
+ */
+struct spi_stats_t {
+    uint32_t transactions;      //< Device selections
+    uint32_t bytes;             //< Bytes transferred, command bytes included
+    uint32_t cycles;            //< CPU cycles spent, measured with Timer1
+};
+
 /**
  * @function:   spi_init
  * @brief:      Used to initialise SPI interface as master
@@ -41,6 +92,64 @@ extern void spi_init(void);
  */
 extern void spi_wait(void);
 
+#ifdef WITH_SPI_STATS
+/**
+ * @function:   spi_stats_begin
+ * @param:      Operation class(SPI_STATS_*).
+ * @brief:      Starts an operation of the given class. Operations
+ *              may be nested, everything up to the matching
+ *              spi_stats_end call of the outermost operation is
+ *              counted in its class. Interrupt routines talking
+ *              to the device bracket their work with
+ *              spi_stats_suspend and spi_stats_resume.
+ */
+extern void spi_stats_begin(uint8_t class);
+
+/**
+ * @function:   spi_stats_count
+ * @param:      Number of bytes transferred.
+ * @brief:      Counts a transaction in the running operation.
+ */
+extern void spi_stats_count(uint16_t bytes);
+
+/**
+ * @function:   spi_stats_end
+ * @brief:      Ends an operation started by spi_stats_begin.
+ */
+extern void spi_stats_end(void);
+
+/**
+ * @function:   spi_stats_suspend
+ * @brief:      Sets the running operation aside on entry of an
+ *              interrupt routine, so its accesses are counted in
+ *              their own classes. Interrupt routines calling this
+ *              must not nest.
+ */
+extern void spi_stats_suspend(void);
+
+/**
+ * @function:   spi_stats_resume
+ * @brief:      Continues the operation set aside by spi_stats_suspend,
+ *              the time spent in between is not counted in it.
+ */
+extern void spi_stats_resume(void);
+
+/**
+ * @function:   spi_get_stats
+ * @param:      Operation class(SPI_STATS_*).
+ * @param:      Statistics to be filled in.
+ * @brief:      Returns the bus work counted for an operation class
+ *              since startup or the last spi_reset_stats call.
+ */
+extern void spi_get_stats(uint8_t class, struct spi_stats_t* stats);
+
+/**
+ * @function:   spi_reset_stats
+ * @brief:      Clears the statistics of all operation classes.
+ */
+extern void spi_reset_stats(void);
+#endif
+
 /**
  * @function:   spi_write_byte
  * @brief:      Writes a byte over the SPI interface
@@ -65,5 +174,25 @@ extern void spi_write_word(uint16_t data);
  */
 extern uint16_t spi_read_word(void);
 
+/**
+ * @function:   spi_write_block
+ * @param:      Lenght of data to be written.
+ * @param:      Local data buffer to be read from.
+ * @brief:      Writes a block of data over the SPI interface
+ *              back-to-back. The next byte is fetched from
+ *              memory while the current one is shifted out.
+ */
+extern void spi_write_block(uint16_t length, const uint8_t* data);
+
+/**
+ * @function:   spi_read_block
+ * @param:      Lenght of data to be read.
+ * @param:      Local data buffer to be written to.
+ * @brief:      Reads a block of data from the SPI interface
+ *              back-to-back. The next transfer is started
+ *              before the received byte is stored to memory.
+ */
+extern void spi_read_block(uint16_t length, uint8_t* data);
+
 /* !_SPI_H_ */
 #endif
@@ -25,6 +25,34 @@
 
 #include "uart.h"
 
+// USART register mapping, USART0 on parts with more than one
+#if defined(__AVR_ATmega16__) || defined(__AVR_ATmega32__)
+    #define UART_UCSRA UCSRA
+    #define UART_UCSRB UCSRB
+    #define UART_UBRRH UBRRH
+    #define UART_UBRRL UBRRL
+    #define UART_UDR   UDR
+    #define UART_U2X   U2X
+    #define UART_TXEN  TXEN
+    #define UART_RXEN  RXEN
+    #define UART_UDRE  UDRE
+    #define UART_RXC   RXC
+#elif defined(__AVR_ATmega644P__) || defined(__AVR_ATmega644PA__) || \
+      defined(__AVR_ATmega1284__) || defined(__AVR_ATmega1284P__)
+    #define UART_UCSRA UCSR0A
+    #define UART_UCSRB UCSR0B
+    #define UART_UBRRH UBRR0H
+    #define UART_UBRRL UBRR0L
+    #define UART_UDR   UDR0
+    #define UART_U2X   U2X0
+    #define UART_TXEN  TXEN0
+    #define UART_RXEN  RXEN0
+    #define UART_UDRE  UDRE0
+    #define UART_RXC   RXC0
+#else
+    #error *** Check USART settings in uart.c ***
+#endif
+
 /**
  * @function:   uart_init
  * @param:      Transmission baudrate
@@ -41,18 +69,18 @@ uart_init(uint32_t baudrate, bool rx, bool tx)
     uint16_t rate = (F_CPU / (uint32_t)(8 * baudrate)) - 1;
 
     // Set doublespeed mode
-    UCSRA |= (1 << U2X);
+    UART_UCSRA |= (1 << UART_U2X);
 
     // Set baudrate register
-    UBRRH = (uint8_t)(rate >> 8);
-    UBRRL = (uint8_t)(rate);
+    UART_UBRRH = (uint8_t)(rate >> 8);
+    UART_UBRRL = (uint8_t)(rate);
 
     if(tx) {  // Enable transmiter
-        UCSRB |= (1 << TXEN);
+        UART_UCSRB |= (1 << UART_TXEN);
     }
 
     if(rx) {  // Enable receiver
-        UCSRB |= (1 << RXEN);
+        UART_UCSRB |= (1 << UART_RXEN);
     }
 
     sei();
@@ -113,11 +141,11 @@ uart_read(size_t max_length, uint8_t* data)
 void
 uart_write_byte(uint8_t byte)
 {
-    while(!(UCSRA & (1 << UDRE))) {
+    while(!(UART_UCSRA & (1 << UART_UDRE))) {
         continue;
     }
 
-    UDR = byte;
+    UART_UDR = byte;
 }
 
 /**
@@ -129,9 +157,9 @@ uart_write_byte(uint8_t byte)
 uint8_t
 uart_read_byte(void)
 {
-    while(!(UCSRA & (1 << RXC))) {
+    while(!(UART_UCSRA & (1 << UART_RXC))) {
         continue;
     }
 
-    return UDR;
+    return UART_UDR;
 }
@@ -0,0 +1,272 @@
+/**
+ * Copyright 2011 Roy van Dam <roy@8bit.cx>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "xmem.h"
+
+// Allocated buffers, sorted by address
+static struct xmem_block_t xmem_blocks[XMEM_MAX_BLOCKS];
+static uint8_t xmem_count;
+
+/**
+ * @function:   xmem_find
+ * @param:      Allocated buffer.
+ * @return:     Buffer table entry or NULL when not allocated.
+ */
+static struct xmem_block_t*
+xmem_find(xmem_t block)
+{
+    uint8_t i;
+
+    for(i = 0; i < xmem_count; i++) {
+        if(xmem_blocks[i].address == block) {
+            return &xmem_blocks[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @function:   xmem_limit
+ * @param:      Allocated buffer.
+ * @param:      Offset from the start of the buffer.
+ * @param:      Requested lenght.
+ * @return:     Lenght limited to the end of the buffer.
+ */
+static uint16_t
+xmem_limit(xmem_t block, uint16_t offset, uint16_t length)
+{
+    uint16_t size = xmem_length(block);
+
+    if(offset >= size) {
+        return 0;
+    }
+
+    if(length > size - offset) {
+        length = size - offset;
+    }
+
+    return length;
+}
+
+/**
+ * @function:   xmem_alloc
+ * @param:      Lenght of the buffer in bytes.
+ * @return:     Allocated buffer or XMEM_NULL when there is no room.
+ * @brief:      Allocates a buffer in the part of the controller
+ *              memory set aside by ETH_XMEM_SIZE.
+ */
+xmem_t
+xmem_alloc(uint16_t length)
+{
+    uint16_t address = ETH_REG_XMEM_START;
+    uint8_t i;
+
+    if((length == 0) || (xmem_count == XMEM_MAX_BLOCKS)) {
+        return XMEM_NULL;
+    }
+
+    // Find the first gap between the buffers large enough
+    for(i = 0; i < xmem_count; i++) {
+        if(xmem_blocks[i].address - address >= length) {
+            break;
+        }
+
+        address = xmem_blocks[i].address + xmem_blocks[i].length;
+    }
+
+    // Or room behind the last buffer
+    if((i == xmem_count) && ((ETH_REG_XMEM_STOP + 1) - address < length)) {
+        return XMEM_NULL;
+    }
+
+    // Insert the buffer, keeping the table sorted
+    memmove(&xmem_blocks[i + 1], &xmem_blocks[i], (xmem_count - i) * sizeof(struct xmem_block_t));
+
+    xmem_blocks[i].address = address;
+    xmem_blocks[i].length = length;
+    xmem_count++;
+
+    return address;
+}
+
+/**
+ * @function:   xmem_free
+ * @param:      Buffer to be released.
+ * @brief:      Returns a buffer allocated by xmem_alloc.
+ */
+void
+xmem_free(xmem_t block)
+{
+    struct xmem_block_t* entry = xmem_find(block);
+    uint8_t i;
+
+    if(entry == NULL) {
+        return;
+    }
+
+    i = entry - xmem_blocks;
+
+    // Close the gap in the table
+    memmove(&xmem_blocks[i], &xmem_blocks[i + 1], (xmem_count - i - 1) * sizeof(struct xmem_block_t));
+
+    xmem_count--;
+}
+
+/**
+ * @function:   xmem_length
+ * @param:      Allocated buffer.
+ * @return:     Lenght of the buffer, 0 if it is not allocated.
+ */
+uint16_t
+xmem_length(xmem_t block)
+{
+    struct xmem_block_t* entry = xmem_find(block);
+
+    return (entry) ? entry->length : 0;
+}
+
+/**
+ * @function:   xmem_available
+ * @return:     Number of bytes not allocated.
+ * @brief:      The free bytes may be spread over several gaps, a
+ *              buffer of this size does not always fit.
+ */
+uint16_t
+xmem_available(void)
+{
+    uint16_t available = ETH_XMEM_SIZE;
+    uint8_t i;
+
+    for(i = 0; i < xmem_count; i++) {
+        available -= xmem_blocks[i].length;
+    }
+
+    return available;
+}
+
+/**
+ * @function:   xmem_write
+ * @param:      Buffer to be written to.
+ * @param:      Offset from the start of the buffer.
+ * @param:      Lenght of data to be written.
+ * @param:      Local data buffer to be read from.
+ * @brief:      Writes data into a buffer, limited to its end.
+ */
+void
+xmem_write(xmem_t block, uint16_t offset, uint16_t length, uint8_t* data)
+{
+    uint16_t address = block + offset;
+
+    length = xmem_limit(block, offset, length);
+
+    if(length == 0) {
+        return;
+    }
+
+    // Set the write pointer
+    eth_write_byte(EWRPTL, address & 0xFF);
+    eth_write_byte(EWRPTH, address >> 8);
+
+    // Copy the data into the buffer
+    eth_write_buffer(length, data);
+}
+
+/**
+ * @function:   xmem_read
+ * @param:      Buffer to be read from.
+ * @param:      Offset from the start of the buffer.
+ * @param:      Lenght of data to be read.
+ * @param:      Local data buffer to be written to, followed by
+ *              a string delimiter.
+ * @return:     Number of bytes read, limited to the end of the buffer.
+ */
+uint16_t
+xmem_read(xmem_t block, uint16_t offset, uint16_t length, uint8_t* data)
+{
+    uint16_t address = block + offset;
+
+    length = xmem_limit(block, offset, length);
+
+    // The interrupt routine moves the read pointer when it
+    // drains frames into the ring(WITH_ETH_RX_ISR).
+    eth_lock();
+
+    // Set the read pointer
+    eth_write_byte(ERDPTL, address & 0xFF);
+    eth_write_byte(ERDPTH, address >> 8);
+
+    // Copy the data from the buffer
+    eth_read_buffer(length, data);
+
+    eth_unlock();
+
+    return length;
+}
+
+/**
+ * @function:   xmem_copy
+ * @param:      Buffer to be copied to.
+ * @param:      Offset from the start of the destination buffer.
+ * @param:      Buffer to be copied from.
+ * @param:      Offset from the start of the source buffer.
+ * @param:      Lenght of data to be copied.
+ * @brief:      Copies data between buffers using the controller
+ *              DMA, limited to the end of both buffers.
+ */
+void
+xmem_copy(xmem_t destination, uint16_t destination_offset,
+          xmem_t source, uint16_t source_offset, uint16_t length)
+{
+    length = xmem_limit(destination, destination_offset, length);
+    length = xmem_limit(source, source_offset, length);
+
+    if(length == 0) {
+        return;
+    }
+
+    eth_dma_copy(destination + destination_offset, source + source_offset,
+                 source + source_offset + length - 1);
+}
+
+/**
+ * @function:   xmem_send
+ * @param:      Buffer holding the packet.
+ * @param:      Offset of the packet from the start of the buffer.
+ * @param:      Lenght of the packet to be send.
+ * @brief:      Sends a packet kept in a buffer, e.g. for a
+ *              retransmission, without passing it over SPI.
+ */
+void
+xmem_send(xmem_t block, uint16_t offset, uint16_t length)
+{
+    length = xmem_limit(block, offset, length);
+
+    if(length == 0) {
+        return;
+    }
+
+    eth_send_memory(block + offset, length);
+}
@@ -0,0 +1,135 @@
+/**
+ * Copyright 2011 Roy van Dam <roy@8bit.cx>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "eth.h"
+
+#ifndef _XMEM_H_
+#define _XMEM_H_
+
+// Number of buffers that can be allocated at once
+#ifndef XMEM_MAX_BLOCKS
+#define XMEM_MAX_BLOCKS 8
+#endif
+
+// Returned when no buffer could be allocated
+#define XMEM_NULL 0
+
+/**
+ * @type:       xmem_t
+ * @brief:      Buffer located in the ethernet controller memory,
+ *              the controller address of its first byte.
+ */
+typedef uint16_t xmem_t;
+
+/**
+ * @struct:     xmem_block_t
+ * @brief:      Allocated range of the controller memory.
+ */
+struct xmem_block_t {
+    uint16_t address;           //< Controller address of the first byte
+    uint16_t length;            //< Number of bytes
+};
+
+/**
+ * @function:   xmem_alloc
+ * @param:      Lenght of the buffer in bytes.
+ * @return:     Allocated buffer or XMEM_NULL when there is no room.
+ * @brief:      Allocates a buffer in the part of the controller
+ *              memory set aside by ETH_XMEM_SIZE.
+ */
+extern xmem_t xmem_alloc(uint16_t length);
+
+/**
+ * @function:   xmem_free
+ * @param:      Buffer to be released.
+ * @brief:      Returns a buffer allocated by xmem_alloc.
+ */
+extern void xmem_free(xmem_t block);
+
+/**
+ * @function:   xmem_length
+ * @param:      Allocated buffer.
+ * @return:     Lenght of the buffer, 0 if it is not allocated.
+ */
+extern uint16_t xmem_length(xmem_t block);
+
+/**
+ * @function:   xmem_available
+ * @return:     Number of bytes not allocated.
+ * @brief:      The free bytes may be spread over several gaps, a
+ *              buffer of this size does not always fit.
+ */
+extern uint16_t xmem_available(void);
+
+/**
+ * @function:   xmem_write
+ * @param:      Buffer to be written to.
+ * @param:      Offset from the start of the buffer.
+ * @param:      Lenght of data to be written.
+ * @param:      Local data buffer to be read from.
+ * @brief:      Writes data into a buffer, limited to its end.
+ */
+extern void xmem_write(xmem_t block, uint16_t offset, uint16_t length, uint8_t* data);
+
+/**
+ * @function:   xmem_read
+ * @param:      Buffer to be read from.
+ * @param:      Offset from the start of the buffer.
+ * @param:      Lenght of data to be read.
+ * @param:      Local data buffer to be written to, followed by
+ *              a string delimiter.
+ * @return:     Number of bytes read, limited to the end of the buffer.
+ */
+extern uint16_t xmem_read(xmem_t block, uint16_t offset, uint16_t length, uint8_t* data);
+
+/**
+ * @function:   xmem_copy
+ * @param:      Buffer to be copied to.
+ * @param:      Offset from the start of the destination buffer.
+ * @param:      Buffer to be copied from.
+ * @param:      Offset from the start of the source buffer.
+ * @param:      Lenght of data to be copied.
+ * @brief:      Copies data between buffers using the controller
+ *              DMA, limited to the end of both buffers.
+ */
+extern void xmem_copy(xmem_t destination, uint16_t destination_offset,
+                      xmem_t source, uint16_t source_offset, uint16_t length);
+
+/**
+ * @function:   xmem_send
+ * @param:      Buffer holding the packet.
+ * @param:      Offset of the packet from the start of the buffer.
+ * @param:      Lenght of the packet to be send.
+ * @brief:      Sends a packet kept in a buffer, e.g. for a
+ *              retransmission, without passing it over SPI.
+ */
+extern void xmem_send(xmem_t block, uint16_t offset, uint16_t length);
+
+/* !_XMEM_H_ */
+#endif
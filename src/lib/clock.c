@@ -25,6 +25,18 @@
 
 #include "clock.h"
 
+// Timer0 compare match interrupt
+#if defined(__AVR_ATmega32__)
+    #define CLOCK_TIMER_vect TIMER0_COMP_vect
+    #define CLOCK_TIMER_TIFR TIFR
+    #define CLOCK_TIMER_OCF  OCF0
+#elif defined(__AVR_ATmega644P__) || defined(__AVR_ATmega644PA__) || \
+      defined(__AVR_ATmega1284__) || defined(__AVR_ATmega1284P__)
+    #define CLOCK_TIMER_vect TIMER0_COMPA_vect
+    #define CLOCK_TIMER_TIFR TIFR0
+    #define CLOCK_TIMER_OCF  OCF0A
+#endif
+
 // Time containers
 static volatile clock_timestamp_t timestamp;
 static volatile clock_microtime_t microtime;
@@ -42,9 +54,15 @@ clock_init(void)
 
     // Configure hardware timer for 1 ms CTC
 #if defined(__AVR_ATmega32__)
-    OCR0 = 249;
+    OCR0 = CLOCK_TICKS_PER_MS - 1;
     TCCR0 = (1 << WGM01) | (1 << CS00) | (1 << CS01);
     TIMSK |= (1 << OCIE0);
+#elif defined(__AVR_ATmega644P__) || defined(__AVR_ATmega644PA__) || \
+      defined(__AVR_ATmega1284__) || defined(__AVR_ATmega1284P__)
+    OCR0A = CLOCK_TICKS_PER_MS - 1;
+    TCCR0A = (1 << WGM01);
+    TCCR0B = (1 << CS00) | (1 << CS01);
+    TIMSK0 |= (1 << OCIE0A);
 #else
 #error *** Check timer settings in clock.c *** 
 #endif
@@ -109,10 +127,41 @@ clock_microtime(void)
 }
 
 /**
- * @ISR:        TIMER0_COMP_vect
+ * @function:   clock_get_stamp
+ * @param:      Time point to be filled in.
+ * @brief:      Captures the current time including the timer
+ *              ticks into the millisecond(CLOCK_TICKS_PER_MS).
+ *              Safe to be called from an interrupt routine.
+ */
+void
+clock_get_stamp(struct clock_time_t* time)
+{
+    uint8_t sreg = SREG;
+
+    cli();
+
+    time->timestamp = timestamp;
+    time->microtime = microtime;
+    time->ticks = TCNT0;
+
+    // The counter wrapped but the tick has not been handled yet
+    if(CLOCK_TIMER_TIFR & (1 << CLOCK_TIMER_OCF)) {
+        time->ticks = TCNT0;
+
+        if(++time->microtime == 1000) {
+            time->microtime = 0;
+            time->timestamp++;
+        }
+    }
+
+    SREG = sreg;
+}
+
+/**
+ * @ISR:        CLOCK_TIMER_vect
  * @brief:      1 ms periodic clock interrupt
  */
-ISR(TIMER0_COMP_vect)
+ISR(CLOCK_TIMER_vect)
 {
     clock_tick();
 }
@@ -31,6 +31,9 @@
 #ifndef _CLOCK_H_
 #define _CLOCK_H_
 
+// Timer ticks(64 CPU cycles) per millisecond
+#define CLOCK_TICKS_PER_MS (F_CPU / 64000UL)
+
 /**
  * @type:       clock_timestamp_t
  * @brief:      Time representation in secconds.
@@ -49,6 +52,7 @@ typedef uint16_t clock_microtime_t;
 struct clock_time_t {
     clock_timestamp_t timestamp;
     clock_microtime_t microtime;
+    uint8_t ticks;              //< Timer ticks into the millisecond
 };
 
 /**
@@ -86,5 +90,14 @@ extern clock_timestamp_t clock_time(void);
  */
 extern clock_microtime_t clock_microtime(void);
 
+/**
+ * @function:   clock_get_stamp
+ * @param:      Time point to be filled in.
+ * @brief:      Captures the current time including the timer
+ *              ticks into the millisecond(CLOCK_TICKS_PER_MS).
+ *              Safe to be called from an interrupt routine.
+ */
+extern void clock_get_stamp(struct clock_time_t* time);
+
 /* !_CLOCK_H_ */
 #endif
@@ -28,6 +28,7 @@
 #include <avr/pgmspace.h>
 
 #include "dev/eth.h"
+#include "dev/spi.h"
 
 #include "lib/clock.h"
 #include "lib/timer.h"
@@ -41,6 +42,7 @@
 #include "net/ip.h"
 
 #include "app/echo.h"
+#include "app/bench.h"
 
 // Ethernet MAC address
 mac_addr_t mac_address = {0x54, 0x55, 0x58, 0x10, 0x00, 0x24};
@@ -50,6 +52,13 @@ ip_addr_t ip_address = {10, 0, 1, 30};
 ip_mask_t netmask = {255, 255, 225, 0};
 ip_addr_t default_router = {10, 0, 1, 1};
 
+#ifdef WITH_SPI_STATS
+// Names of the SPI statistics classes
+static const char spi_class_names[SPI_STATS_CLASSES][10] PROGMEM = {
+    "Reg read", "Reg write", "Bank", "PHY", "Buf read", "Buf write"
+};
+#endif
+
 #ifndef WITH_DEBUG
 bool
 display_status(void)
@@ -70,7 +79,8 @@ display_status(void)
     net_status = net_get_status();
 
     printf_P(PSTR("Network connection:\n"));
-    printf_P(PSTR(" Link state: [ %s ]\n\n"), (net_status->link) ? "UP" : "DOWN");
+    printf_P(PSTR(" Link state: [ %s ]\n"), (net_status->link) ? "UP" : "DOWN");
+    printf_P(PSTR(" Duplex mode: [ %s ]\n\n"), (net_status->full_duplex) ? "FULL" : "HALF");
 
     printf_P(PSTR(" Packets sent: %lu\n"), net_status->packets_sent);
 
@@ -125,6 +135,36 @@ display_status(void)
 
     bytes_received = net_status->bytes_received;
 
+    printf_P(PSTR("\n Receive overflow events: %lu\n"), net_status->rx_overflow_events);
+    printf_P(PSTR(" Receive CRC errors: %lu\n"), net_status->rx_crc_errors);
+    printf_P(PSTR(" Receive truncated: %lu\n"), net_status->rx_truncated);
+    printf_P(PSTR(" Receive pauses: %lu\n"), net_status->rx_pauses);
+    printf_P(PSTR(" Receive resets: %u\n"), net_status->rx_resets);
+    printf_P(PSTR(" Receive buffer: %u/%u Bytes\n"), net_status->rx_occupancy, ETH_RX_BUFFER_SIZE);
+    printf_P(PSTR(" Receive high-water: %u Bytes\n"), net_status->rx_high_water);
+
+#ifdef WITH_ETH_TX_STATUS
+    printf_P(PSTR("\n Transmit collisions: %lu\n"), net_status->tx_collisions);
+    printf_P(PSTR(" Transmit late collisions: %lu\n"), net_status->tx_late_collisions);
+    printf_P(PSTR(" Transmit deferrals: %lu\n"), net_status->tx_deferrals);
+    printf_P(PSTR(" Transmit aborts: %lu\n"), net_status->tx_aborts);
+    printf_P(PSTR(" Transmit retries: %lu\n"), net_status->tx_retries);
+#endif
+
+#ifdef WITH_SPI_STATS
+    struct spi_stats_t spi_stats;
+    uint8_t i;
+
+    printf_P(PSTR("\n SPI        Transactions      Bytes     Cycles\n"));
+
+    for(i = 0; i < SPI_STATS_CLASSES; i++) {
+        spi_get_stats(i, &spi_stats);
+
+        printf_P(PSTR(" %-10S %12lu %10lu %10lu\n"), spi_class_names[i],
+                 spi_stats.transactions, spi_stats.bytes, spi_stats.cycles);
+    }
+#endif
+
     return true;
 }
 #endif
@@ -151,6 +191,11 @@ main(void)
     // Initialise ethernet controller
     eth_init(mac_address);
 
+#ifdef WITH_BENCHMARK
+    // Measure controller transfer performance
+    bench_spi();
+#endif
+
     // Initialise network stack
     net_init(mac_address, ip_address, netmask, default_router);
 
@@ -148,6 +148,26 @@ arp_flush(void)
     return true;
 }
 
+/**
+ * @function:   arp_set_filter
+ * @param:      ip_addr_t, IP address of the host.
+ * @brief:      Programs the ethernet controller to only pass
+ *              broadcast ARP packets asking for the given address.
+ */
+void
+arp_set_filter(ip_addr_t ip_addr)
+{
+    static const uint8_t type[2] = {MAC_TYPE_ARP >> 8, MAC_TYPE_ARP & 0xFF};
+
+    struct eth_filter_field_t fields[] = {
+        {offsetof(struct arp_header_t, mac.dest_addr), 6, mac_broadcast_addr},
+        {offsetof(struct arp_header_t, mac.type), 2, type},
+        {offsetof(struct arp_header_t, ip_dest_addr), 4, ip_addr}
+    };
+
+    eth_set_pattern_filter(fields, 3);
+}
+
 /**
  * @function:   arp_decode
  * @param:      uint16_t, Length of the packet received.
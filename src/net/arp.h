@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include <avr/pgmspace.h>
 
@@ -39,7 +40,9 @@
 #define _ARP_H_
 
 // ARP Settings
+#ifndef ARP_TABLE_SIZE
 #define ARP_TABLE_SIZE    10
+#endif
 #define ARP_ENTRY_MAX_AGE 120
 #define ARP_HARDWARE_TYPE 1
 
@@ -104,6 +107,14 @@ extern void arp_update (ip_addr_t ip_addr, mac_addr_t mac_addr);
  */
 extern bool arp_flush (void);
 
+/**
+ * @function:   arp_set_filter
+ * @param:      ip_addr_t, IP address of the host.
+ * @brief:      Programs the ethernet controller to only pass
+ *              broadcast ARP packets asking for the given address.
+ */
+extern void arp_set_filter (ip_addr_t ip_addr);
+
 /**
  * @function:   arp_decode
  * @param:      uint16_t, Length of the packet received.
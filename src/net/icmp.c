@@ -25,6 +25,7 @@
  */
 
 #include "icmp.h"
+#include "net.h"
 
 /**
  * @function:   icmp_decode
@@ -106,9 +107,21 @@ icmp_checksum(uint16_t length, uint8_t* packet)
 uint16_t
 icmp_echo_reply(uint16_t length, uint8_t* packet)
 {
+    uint32_t sum = 0;
+    uint16_t icmp_length = 0;
+
     // Create header overlay
     struct icmp_header_t* icmp_header = (struct icmp_header_t*)(packet);
 
+    // Length of the ICMP message
+    icmp_length = htons(icmp_header->ip.length) - IP_DEFAULT_HEADER_LENGTH;
+
+    // Check if the whole message has been received
+    if((icmp_length < ICMP_DEFAULT_HEADER_LENGTH) ||
+       (icmp_length > length - (MAC_DEFAULT_HEADER_LENGTH + IP_DEFAULT_HEADER_LENGTH))) {
+        return 0;
+    }
+
     // Set new destination and source mac address
     memcpy(icmp_header->ip.mac.dest_addr, icmp_header->ip.mac.src_addr, 6);
     memcpy(icmp_header->ip.mac.src_addr, mac_get_host_addr(), 6);
@@ -123,12 +136,25 @@ icmp_echo_reply(uint16_t length, uint8_t* packet)
     // Change the ICMP code from echo-request to echo-reply
     icmp_header->type = ICMP_CODE_ECHO_REPLY;
 
-    // Recalculate the ICMP checksum
-    icmp_header->checksum = 0;	// First, it should be set to 0
-    icmp_header->checksum = htons(icmp_checksum(ICMP_DEFAULT_HEADER_LENGTH + 56, &packet[MAC_DEFAULT_HEADER_LENGTH + IP_DEFAULT_HEADER_LENGTH]));
+    // Recalculate the ICMP checksum, the message following the checksum
+    // field is still held by the ethernet controller
+    sum = (uint16_t) ~eth_rx_checksum(MAC_DEFAULT_HEADER_LENGTH + IP_DEFAULT_HEADER_LENGTH + 4, icmp_length - 4);
+    sum += (icmp_header->type << 8) | icmp_header->code;
+
+    // Take only 16 bits out of the 32 bit sum and add up the carries
+    while(sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    // One's complement the result
+    icmp_header->checksum = htons((uint16_t)(~sum));
+
+    // Only the headers up to the checksum have changed, the echo
+    // data is copied from the request by the ethernet controller
+    net_set_reply_header(MAC_DEFAULT_HEADER_LENGTH + IP_DEFAULT_HEADER_LENGTH + 4);
 
     // Return the size of the packet for transmission
-    return sizeof(struct icmp_header_t);
+    return MAC_DEFAULT_HEADER_LENGTH + IP_DEFAULT_HEADER_LENGTH + icmp_length;
 }
 
 /**
@@ -25,6 +25,7 @@
  */
 
 #include "ip.h"
+#include "arp.h"
 
 /**
  * @var:        static ip_addr_t
@@ -79,6 +80,74 @@ ip_checksum(uint16_t length, uint8_t* packet)
     return (uint16_t)(sum);
 }
 
+/**
+ * @function:   ip_pseudo_sum
+ * @param:      Protocol number of the payload
+ * @param:      The length of the payload in bytes
+ * @param:      IP header of the packet
+ * @return:     Sum over the pseudo header, not complemented.
+ * @brief:      Sums the pseudo header covered by the TCP and UDP
+ *              checksums, to be added to the sum of the payload.
+ */
+uint16_t
+ip_pseudo_sum(uint8_t protocol, uint16_t length, struct ip_header_t* ip_header)
+{
+    uint32_t sum = 0;
+    uint8_t i;
+
+    // The protocol number and the length of the payload
+    sum += length + protocol;
+
+    // Add the pseudo header IP source and destination address
+    for(i = 0; i < 4; i += 2) {
+        sum += (ip_header->src_addr[i] << 8) + ip_header->src_addr[i + 1];
+        sum += (ip_header->dest_addr[i] << 8) + ip_header->dest_addr[i + 1];
+    }
+
+    // Take only 16 bits out of the 32 bit sum and add up the carries
+    while(sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    return (uint16_t)(sum);
+}
+
+/**
+ * @function:   ip_rx_checksum
+ * @param:      Protocol number of the payload
+ * @param:      The length of the payload in bytes
+ * @param:      IP header of the received packet
+ * @return:     Checksum over the payload and pseudo header,
+ *              zero when the payload carries a valid checksum.
+ * @brief:      Calculates the checksum of a received TCP or UDP
+ *              payload using the ethernet controller checksum
+ *              engine. Only the pseudo header is summed here.
+ */
+uint16_t
+ip_rx_checksum(uint8_t protocol, uint16_t length, struct ip_header_t* ip_header)
+{
+    uint32_t sum = 0;
+
+    // Payload can not be larger than the frame
+    if(length > ETH_MAX_PAYLOAD_LENGTH) {
+        return 0xFFFF;
+    }
+
+    // Sum of the payload still held by the ethernet controller
+    sum = (uint16_t) ~eth_rx_checksum(MAC_DEFAULT_HEADER_LENGTH + IP_DEFAULT_HEADER_LENGTH, length);
+
+    // The pseudo header
+    sum += ip_pseudo_sum(protocol, length, ip_header);
+
+    // Take only 16 bits out of the 32 bit sum and add up the carries
+    while(sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    // One's complement the result
+    return (uint16_t)(~sum);
+}
+
 /**
  * @function:   ip_decode
  * @param:      The length of the received data in bytes
@@ -151,12 +220,16 @@ ip_mask_compare(const ip_addr_t ip_addr_a, const ip_addr_t ip_addr_b, const ip_m
 /**
  * @function:   ip_set_host_addr
  * @param:      Network IP address
- * @brief:      Sets local network IP address
+ * @brief:      Sets local network IP address and has the
+ *              ethernet controller filter ARP requests for it.
  */
 inline void
 ip_set_host_addr(ip_addr_t ip_addr)
 {
     memcpy(ip_host_addr, ip_addr, 4);
+
+    // Only pass ARP broadcasts asking for the new address
+    arp_set_filter(ip_host_addr);
 }
 
 /**
@@ -32,6 +32,8 @@
 
 #include <avr/pgmspace.h>
 
+#include "dev/eth.h"
+
 #include "mac.h"
 #include "util.h"
 
@@ -96,6 +98,30 @@ struct ip_header_t {
  */
 extern uint16_t ip_checksum(uint16_t length, uint8_t* packet);
 
+/**
+ * @function:   ip_pseudo_sum
+ * @param:      Protocol number of the payload
+ * @param:      The length of the payload in bytes
+ * @param:      IP header of the packet
+ * @return:     Sum over the pseudo header, not complemented.
+ * @brief:      Sums the pseudo header covered by the TCP and UDP
+ *              checksums, to be added to the sum of the payload.
+ */
+extern uint16_t ip_pseudo_sum(uint8_t protocol, uint16_t length, struct ip_header_t* ip_header);
+
+/**
+ * @function:   ip_rx_checksum
+ * @param:      Protocol number of the payload
+ * @param:      The length of the payload in bytes
+ * @param:      IP header of the received packet
+ * @return:     Checksum over the payload and pseudo header,
+ *              zero when the payload carries a valid checksum.
+ * @brief:      Calculates the checksum of a received TCP or UDP
+ *              payload using the ethernet controller checksum
+ *              engine. Only the pseudo header is summed here.
+ */
+extern uint16_t ip_rx_checksum(uint8_t protocol, uint16_t length, struct ip_header_t* ip_header);
+
 /**
  * @function:   ip_decode
  * @param:      The length of the received data in bytes
@@ -138,7 +164,8 @@ extern bool ip_mask_compare(const ip_addr_t ip_addr_a, const ip_addr_t ip_addr_b
 /**
  * @function:   ip_set_host_addr
  * @param:      Network IP address
- * @brief:      Sets local network IP address
+ * @brief:      Sets local network IP address and has the
+ *              ethernet controller filter ARP requests for it.
  */
 extern void ip_set_host_addr(ip_addr_t ip_addr);
 
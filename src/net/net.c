@@ -31,7 +31,77 @@ static struct net_status_t net_status;
 
 // Local packet buffer
 static uint16_t net_packet_length = 0;
-static uint8_t  net_packet_buffer[500] = {0};
+static uint16_t net_packet_pulled = 0;
+static uint16_t net_reply_header = 0;
+
+// Checksum of the reply filled in by the ethernet controller
+static struct eth_checksum_t net_reply_checksum;
+static bool net_reply_checksummed = false;
+
+// Packets too large for the packet buffer
+static uint32_t net_rx_truncated = 0;
+
+// Arrival time of the packet being handled
+static struct clock_time_t net_rx_stamp;
+
+#ifdef WITH_ETH_RX_ISR
+// Ring slot of the packet being handled
+static uint8_t* net_packet_buffer;
+#else
+static uint8_t  net_packet_buffer[NET_PACKET_BUFFER_SIZE] = {0};
+#endif
+
+/**
+ * @function:   net_receive
+ * @return:     True when a packet is to be handled.
+ * @brief:      Fetches the next packet into the packet buffer. Only
+ *              the headers are read from the ethernet controller,
+ *              packets from the frame ring(WITH_ETH_RX_ISR) are
+ *              handled in place. The packet length is zero for an
+ *              invalid packet.
+ */
+static bool
+net_receive(void)
+{
+#ifdef WITH_ETH_RX_ISR
+    // The ring slot holds the whole packet
+    net_packet_length = eth_rx_ring_get(&net_packet_buffer);
+    net_packet_pulled = net_packet_length;
+
+    return (net_packet_length != 0);
+#else
+    if(!eth_get_rx_packet_count()) {
+        return false;
+    }
+
+    // Read packet headers from ethernet controller
+    net_packet_length = eth_peek_packet(NET_PEEK_LENGTH, net_packet_buffer);
+    net_packet_pulled = (net_packet_length < NET_PEEK_LENGTH) ? net_packet_length : NET_PEEK_LENGTH;
+
+    return true;
+#endif
+}
+
+/**
+ * @function:   net_set_link
+ * @param:      New link status
+ * @brief:      Updates the cached link status. Address mappings
+ *              learned before a link change may be stale, so the
+ *              ARP table is flushed.
+ */
+static void
+net_set_link(bool link)
+{
+    // Link status unchanged?
+    if(link == net_status.link) {
+        return;
+    }
+
+    net_status.link = link;
+
+    // Forget the address mappings of the previous link
+    arp_init();
+}
 
 /**
  * @function:   net_init
@@ -58,10 +128,12 @@ net_init(mac_addr_t mac_address, ip_addr_t ip, ip_mask_t netmask, ip_addr_t defa
 
     // Get actual link status
     net_status.link = eth_get_link_status();
+    net_status.full_duplex = eth_is_full_duplex();
 
     // Drop some status information
     printf_P(PSTR("Chip Revision: %u\n"), eth_get_revision());
-    printf_P(PSTR("Link status: %s\n\n"), (net_status.link) ? "UP" : "DOWN");
+    printf_P(PSTR("Link status: %s\n"), (net_status.link) ? "UP" : "DOWN");
+    printf_P(PSTR("Duplex mode: %s\n\n"), (net_status.full_duplex) ? "FULL" : "HALF");
 }
 
 /**
@@ -69,10 +141,30 @@ net_init(mac_addr_t mac_address, ip_addr_t ip, ip_mask_t netmask, ip_addr_t defa
  * @return:     Interface status and statistics
  * @brief:      Returns current interface status
  *              and statistics. Containing link
- *              status and transmission statistics.
+ *              status, transmission and receive
+ *              error statistics.
  */
 const struct net_status_t*
 net_get_status(void) {
+    struct eth_stats_t stats;
+
+    // Collect the ethernet controller statistics
+    eth_get_stats(&stats);
+
+    net_status.rx_overflow_events = stats.rx_overflow_events;
+    net_status.rx_crc_errors = stats.rx_crc_errors;
+    net_status.rx_truncated = stats.rx_truncated + net_rx_truncated;
+    net_status.rx_pauses = stats.rx_pauses;
+    net_status.rx_resets = stats.rx_resets;
+    net_status.rx_high_water = stats.rx_high_water;
+    net_status.rx_occupancy = eth_get_rx_occupancy();
+
+    net_status.tx_collisions = stats.tx_collisions;
+    net_status.tx_late_collisions = stats.tx_late_collisions;
+    net_status.tx_deferrals = stats.tx_deferrals;
+    net_status.tx_aborts = stats.tx_aborts;
+    net_status.tx_retries = stats.tx_retries;
+
     return &net_status;
 }
 
@@ -88,13 +180,35 @@ net_get_status(void) {
 void
 net_periodic(void)
 {
+    uint8_t events = eth_get_events();
+
+    // The receive interrupt may get lost(see Rev. B4 Silicon
+    // Errata point 6), look for frames now and then.
+    if(!(events & ETH_EVENT_RX) && eth_rx_poll()) {
+        events |= ETH_EVENT_RX;
+    }
+
+    // Nothing to do until the controller raises an event
+    if(!events) {
+        return;
+    }
+
     // Update link status
-    net_status.link = eth_get_link_status();
+    if(events & ETH_EVENT_LINK) {
+        net_set_link(eth_ack_link_change());
+    }
+
+    // Free completed transmit slots
+    if(events & ETH_EVENT_TX) {
+        eth_tx_periodic();
+    }
 
     // Handle incomming packets
-    while(eth_get_rx_packet_count()) {
-        // Read packet from ethernet controller
-        net_packet_length = eth_receive_packet(500, net_packet_buffer);
+    while(net_receive()) {
+        net_reply_header = 0;
+        net_reply_checksummed = false;
+
+        eth_get_rx_stamp(&net_rx_stamp);
 
         // Update statistics
         net_status.packets_received++;
@@ -102,6 +216,9 @@ net_periodic(void)
 
 #ifdef WITH_DEBUG
         net_debug(net_status.packets_received, net_packet_length, net_packet_buffer);
+
+        printf_P(PSTR("Received at: %lu.%03u s + %u/%lu ms\n"), net_rx_stamp.timestamp,
+                 net_rx_stamp.microtime, net_rx_stamp.ticks, CLOCK_TICKS_PER_MS);
 #endif
 
         // Decode packet, and reply if necessary.
@@ -115,9 +232,103 @@ net_periodic(void)
 #endif
 
             // Sent packet to ethernet controller
-            eth_send_packet(net_packet_length, net_packet_buffer);
+            if(net_reply_header) {
+                eth_send_reply(net_packet_length, net_reply_header, net_packet_buffer,
+                               net_reply_checksummed ? &net_reply_checksum : NULL);
+            } else {
+                eth_send_packet(net_packet_length, net_packet_buffer);
+            }
         }
+
+#ifdef WITH_ETH_RX_ISR
+        // Hand the ring slot back to the controller interrupt
+        eth_rx_ring_release();
+#else
+        // Free the packet in the ethernet controller
+        eth_release_packet();
+#endif
     }
+
+    // Wait for new events
+    eth_enable_interrupt();
+}
+
+/**
+ * @function:   net_pull
+ * @param:      Number of bytes needed from the start of the packet
+ * @return:     True when the packet buffer holds the requested bytes
+ * @brief:      Copies the missing part of the current packet from
+ *              the ethernet controller into the packet buffer.
+ *              Protocol handlers call this before accessing data
+ *              beyond the first NET_PEEK_LENGTH bytes.
+ */
+bool
+net_pull(uint16_t length)
+{
+    // Limit to the received packet
+    if(length > net_packet_length) {
+        length = net_packet_length;
+    }
+
+    // Check if it fits the packet buffer(including string delimiter)
+    if(length > NET_PACKET_BUFFER_SIZE - 1) {
+        net_rx_truncated++;
+        return false;
+    }
+
+    // Read the missing part
+    if(length > net_packet_pulled) {
+        eth_read_packet(net_packet_pulled, length - net_packet_pulled, net_packet_buffer + net_packet_pulled);
+        net_packet_pulled = length;
+    }
+
+    return true;
+}
+
+/**
+ * @function:   net_get_rx_stamp
+ * @return:     Arrival time of the packet being handled
+ * @brief:      Protocol handlers use this to learn when the packet
+ *              they are handling was received by the controller.
+ */
+const struct clock_time_t*
+net_get_rx_stamp(void)
+{
+    return &net_rx_stamp;
+}
+
+/**
+ * @function:   net_set_reply_header
+ * @param:      Number of bytes that make up the reply header
+ * @brief:      Marks the reply being built as a copy of the
+ *              received packet in which only the header has
+ *              been changed. Only the header is sent from the
+ *              packet buffer, the rest is copied from the
+ *              received packet within the ethernet controller.
+ */
+void
+net_set_reply_header(uint16_t length)
+{
+    net_reply_header = length;
+}
+
+/**
+ * @function:   net_set_reply_checksum
+ * @param:      Packet offset of the first byte covered by the checksum
+ * @param:      Packet offset of the checksum field, zero in the packet
+ * @param:      Partial sum to be added, e.g. of the pseudo header
+ * @brief:      Has the checksum of a reply marked by
+ *              net_set_reply_header calculated by the ethernet
+ *              controller, over the reply in its transmit buffer.
+ */
+void
+net_set_reply_checksum(uint16_t start, uint16_t field, uint16_t sum)
+{
+    net_reply_checksum.start = start;
+    net_reply_checksum.field = field;
+    net_reply_checksum.sum = sum;
+
+    net_reply_checksummed = true;
 }
 
 /**
@@ -137,6 +348,14 @@ net_decode(uint16_t length, uint8_t* packet)
     // Create MAC header structure
     struct mac_header_t* mac_header = (struct mac_header_t*)(packet);
 
+    // Drop multicast packets passed by the hash table filter
+    // for groups that have not been joined.
+    if((mac_header->dest_addr[0] & 0x01) &&
+       memcmp(mac_header->dest_addr, mac_broadcast_addr, 6) &&
+       !eth_is_multicast_member(mac_header->dest_addr)) {
+        return 0;
+    }
+
     // Check for encapsulated protocols
     switch(htons(mac_header->type)) {
         case MAC_TYPE_ARP :
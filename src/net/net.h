@@ -44,14 +44,54 @@
 #ifndef _NET_H_
 #define _NET_H_
 
+/**
+ * @define:     NET_PACKET_BUFFER_SIZE
+ * @brief:      Size of the local packet buffer, packets are handled
+ *              in the ring slot when received by the controller
+ *              interrupt(WITH_ETH_RX_ISR).
+ */
+#ifndef NET_PACKET_BUFFER_SIZE
+    #ifdef WITH_ETH_RX_ISR
+        #define NET_PACKET_BUFFER_SIZE ETH_RX_RING_FRAME_SIZE
+    #else
+        #define NET_PACKET_BUFFER_SIZE 500
+    #endif
+#endif
+
+#if defined(WITH_ETH_RX_ISR) && (NET_PACKET_BUFFER_SIZE != ETH_RX_RING_FRAME_SIZE)
+    #error *** NET_PACKET_BUFFER_SIZE must match ETH_RX_RING_FRAME_SIZE ***
+#endif
+
+/**
+ * @define:     NET_PEEK_LENGTH
+ * @brief:      Number of header bytes read for every packet,
+ *              the rest is pulled in by the protocol handlers.
+ */
+#define NET_PEEK_LENGTH 64
+
 struct net_status_t {
     bool link;
+    bool full_duplex;
 
     uint32_t packets_sent;
     uint32_t bytes_sent;
 
     uint32_t packets_received;
     uint32_t bytes_received;
+
+    uint32_t rx_overflow_events;
+    uint32_t rx_crc_errors;
+    uint32_t rx_truncated;
+    uint32_t rx_pauses;
+    uint16_t rx_resets;
+    uint16_t rx_high_water;
+    uint16_t rx_occupancy;
+
+    uint32_t tx_collisions;
+    uint32_t tx_late_collisions;
+    uint32_t tx_deferrals;
+    uint32_t tx_aborts;
+    uint32_t tx_retries;
 };
 
 /**
@@ -69,7 +109,8 @@ extern void net_init(mac_addr_t mac_address, ip_addr_t ip, ip_mask_t netmask, ip
  * @return:     Interface status and statistics
  * @brief:      Returns current interface status
  *              and statistics. Containing link
- *              status and transmission statistics.
+ *              status, transmission and receive
+ *              error statistics.
  */
 extern const struct net_status_t* net_get_status(void);
 
@@ -84,6 +125,47 @@ extern const struct net_status_t* net_get_status(void);
  */
 extern void net_periodic(void);
 
+/**
+ * @function:   net_pull
+ * @param:      Number of bytes needed from the start of the packet
+ * @return:     True when the packet buffer holds the requested bytes
+ * @brief:      Copies the missing part of the current packet from
+ *              the ethernet controller into the packet buffer.
+ *              Protocol handlers call this before accessing data
+ *              beyond the first NET_PEEK_LENGTH bytes.
+ */
+extern bool net_pull(uint16_t length);
+
+/**
+ * @function:   net_get_rx_stamp
+ * @return:     Arrival time of the packet being handled
+ * @brief:      Protocol handlers use this to learn when the packet
+ *              they are handling was received by the controller.
+ */
+extern const struct clock_time_t* net_get_rx_stamp(void);
+
+/**
+ * @function:   net_set_reply_header
+ * @param:      Number of bytes that make up the reply header
+ * @brief:      Marks the reply being built as a copy of the
+ *              received packet in which only the header has
+ *              been changed. Only the header is sent from the
+ *              packet buffer, the rest is copied from the
+ *              received packet within the ethernet controller.
+ */
+extern void net_set_reply_header(uint16_t length);
+
+/**
+ * @function:   net_set_reply_checksum
+ * @param:      Packet offset of the first byte covered by the checksum
+ * @param:      Packet offset of the checksum field, zero in the packet
+ * @param:      Partial sum to be added, e.g. of the pseudo header
+ * @brief:      Has the checksum of a reply marked by
+ *              net_set_reply_header calculated by the ethernet
+ *              controller, over the reply in its transmit buffer.
+ */
+extern void net_set_reply_checksum(uint16_t start, uint16_t field, uint16_t sum);
+
 /**
  * @function:   net_decode
  * @param:      The packet length
@@ -36,7 +36,9 @@
  * @define:     MAX_SOCKETS
  * @brief:      The maximum number of sockets.
  */
+#ifndef MAX_SOCKETS
 #define MAX_SOCKETS	10
+#endif
 
 /**
  * @type:       sock_type_t
@@ -107,6 +107,11 @@ tcp_decode(uint16_t length, uint8_t* packet)
         return 0;
     }
 
+    // Verify against the segment held by the ethernet controller
+    if(ip_rx_checksum(IP_PROTOCOL_TCP, htons(tcp_header->ip.length) - IP_DEFAULT_HEADER_LENGTH, &tcp_header->ip) != 0) {
+        return 0;
+    }
+
     // XXX: Run TCP state machine.
     //      Still to be implemented.
 
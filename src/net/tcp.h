@@ -45,7 +45,9 @@
  * @define: TCP_MAX_BINDINGS
  * @brief:  The maximum number of TCP port bindings
  */
+#ifndef TCP_MAX_BINDINGS
 #define TCP_MAX_BINDINGS	10
+#endif
 
 /**
  * @define: TCP_HEADER_LENGTH
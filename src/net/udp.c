@@ -88,7 +88,6 @@ uint16_t
 udp_decode(uint16_t length, uint8_t* packet)
 {
     uint8_t id = 0;
-    uint16_t checksum = 0;
 
     // Check packet length
     if(length < sizeof(struct udp_header_t)) {
@@ -98,6 +97,18 @@ udp_decode(uint16_t length, uint8_t* packet)
     // Create UDP header structure
     struct udp_header_t* udp_header = (struct udp_header_t*)(packet);
 
+    uint16_t ip_length = htons(udp_header->ip.length);
+    uint16_t udp_length = htons(udp_header->length);
+
+    // The IP packet must fit the received frame, and the
+    // datagram must fit the IP payload.
+    if((ip_length < IP_DEFAULT_HEADER_LENGTH + UDP_DEFAULT_HEADER_LENGTH) ||
+       (ip_length > length - MAC_DEFAULT_HEADER_LENGTH) ||
+       (udp_length < UDP_DEFAULT_HEADER_LENGTH) ||
+       (udp_length > ip_length - IP_DEFAULT_HEADER_LENGTH)) {
+        return 0;
+    }
+
     // Search for corresponding port binding
     for(; (id < UDP_MAX_BINDINGS) && (udp_bindings[id]->port != htons(udp_header->dest_port)); id++) {
         continue;
@@ -109,16 +120,14 @@ udp_decode(uint16_t length, uint8_t* packet)
     }
 
     // Check UDP checksum when required
-    if((checksum = htons(udp_header->checksum)) != 0) {
-        // Clear checksum
-        udp_header->checksum = 0;
-
-        // Calculate and compare
-        if(checksum != udp_checksum(htons(udp_header->length),
-                                    packet + (MAC_DEFAULT_HEADER_LENGTH + IP_DEFAULT_HEADER_LENGTH),
-                                    udp_header->ip.src_addr, udp_header->ip.dest_addr)) {
+    if(udp_header->checksum != 0) {
+        // Verify against the datagram held by the ethernet controller
+        if(ip_rx_checksum(IP_PROTOCOL_UDP, udp_length, &udp_header->ip) != 0) {
             return 0;
         }
+
+        // Clear checksum
+        udp_header->checksum = 0;
     }
 
     // Create data block pointer
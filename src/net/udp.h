@@ -47,7 +47,9 @@
  * @define:     UDP_MAX_BINDINGS
  * @brief:      The maximum number of UDP port bindings
  */
+#ifndef UDP_MAX_BINDINGS
 #define UDP_MAX_BINDINGS 10
+#endif
 
 /**
  * @struct:		udp_header_t
@@ -68,6 +70,8 @@ struct udp_header_t {
  * @brief:      Callback type for UDP bindings.
  *              These functions are called when
  *              there is inbound data on the bound port.
+ *              Only the headers are in the packet buffer,
+ *              use net_pull before accessing the data.
  */
 typedef uint16_t (*udp_inbound_t)(struct udp_header_t* udp_header, uint8_t* data);
 